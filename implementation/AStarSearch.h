@@ -0,0 +1,482 @@
+#ifndef ASTARSEARCH_H
+#define ASTARSEARCH_H
+
+#include "TopSpinStateSpace.h"
+#include "MovePruning.h"
+#include "AbstractionCache.h"
+#include "Profiling.h"
+#include "Checkpoint.h"
+#include <queue>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <cstdint>
+
+class AStarSearch {
+private:
+    long expandedNodes = 0;
+
+    using NodeId = uint32_t;
+    static constexpr NodeId NO_PARENT = UINT32_MAX;
+
+    struct Node {
+        TopSpinStateSpace::TopSpinState state;
+        TopSpinStateSpace::TopSpinAction action;
+        NodeId parent;
+        int cost;
+        int h;
+        int gaps;
+        uint32_t context;
+
+        Node(const TopSpinStateSpace::TopSpinState& s, NodeId p,
+             const TopSpinStateSpace::TopSpinAction& a, int c, int h, int gaps, uint32_t context)
+            : state(s), action(a), parent(p), cost(c), h(h), gaps(gaps), context(context) {}
+    };
+
+    // Bump allocator for search nodes. Nodes live in fixed-size chunks that are
+    // never reallocated, are addressed by 32-bit index and are all released
+    // together when the arena is cleared. Once every id below NO_PARENT is
+    // taken, allocate returns NO_PARENT and stores nothing.
+    class NodeArena {
+    public:
+        static constexpr size_t CHUNK_BITS = 16;
+        static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+
+        NodeId allocate(const TopSpinStateSpace::TopSpinState& s, NodeId p,
+                        const TopSpinStateSpace::TopSpinAction& a, int c, int h, int gaps = -1, uint32_t context = 0) {
+            if (count >= NO_PARENT) return NO_PARENT;
+            if (chunks.empty() || chunks.back().size() == CHUNK_SIZE) {
+                chunks.emplace_back();
+                chunks.back().reserve(CHUNK_SIZE);
+            }
+            chunks.back().emplace_back(s, p, a, c, h, gaps, context);
+            return static_cast<NodeId>(count++);
+        }
+
+        Node& operator[](NodeId id) { return chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)]; }
+        const Node& operator[](NodeId id) const { return chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)]; }
+
+        size_t size() const { return count; }
+        size_t chunkCount() const { return chunks.size(); }
+        size_t bytesReserved() const { return chunks.size() * CHUNK_SIZE * sizeof(Node); }
+
+        void clear() {
+            chunks.clear();
+            count = 0;
+        }
+
+    private:
+        std::vector<std::vector<Node>> chunks;
+        size_t count = 0;
+    };
+
+    NodeArena nodes;
+    size_t allocatedNodes = 0;
+    size_t arenaChunks = 0;
+    size_t arenaBytes = 0;
+
+    struct CompareNodes {
+        const NodeArena* arena;
+        bool operator()(NodeId ia, NodeId ib) const {
+            const Node& a = (*arena)[ia];
+            const Node& b = (*arena)[ib];
+            int f_a = a.cost + a.h;
+            int f_b = b.cost + b.h;
+            if (f_a != f_b) return f_a > f_b;
+            return a.cost < b.cost;
+        }
+    };
+
+    // Binary heap on a vector, so a checkpoint can walk its contents.
+    class HeapOpenList {
+    public:
+        explicit HeapOpenList(const NodeArena& arena) : compare{&arena} {}
+        void push(NodeId id, int, int) {
+            heap.push_back(id);
+            std::push_heap(heap.begin(), heap.end(), compare);
+        }
+        NodeId pop() {
+            std::pop_heap(heap.begin(), heap.end(), compare);
+            NodeId id = heap.back();
+            heap.pop_back();
+            return id;
+        }
+        bool empty() const { return heap.empty(); }
+        size_t size() const { return heap.size(); }
+        template <typename Visit>
+        void forEach(Visit&& visit) const {
+            for (NodeId id : heap) visit(id);
+        }
+
+    private:
+        CompareNodes compare;
+        std::vector<NodeId> heap;
+    };
+
+    // Two-level bucket queue for integer costs: buckets are indexed by f and
+    // then by g, and pop takes the deepest g within the lowest f, matching the
+    // tie-breaking of CompareNodes.
+    class BucketOpenList {
+    public:
+        explicit BucketOpenList(const NodeArena&) {}
+        void push(NodeId id, int g, int h) {
+            size_t f = static_cast<size_t>(g) + h;
+            if (buckets.size() <= f) buckets.resize(f + 1);
+            auto& byG = buckets[f];
+            if (byG.size() <= static_cast<size_t>(g)) byG.resize(g + 1);
+            byG[g].push_back(id);
+            if (f < minF) minF = f;
+            count++;
+        }
+        NodeId pop() {
+            while (isEmptyF(buckets[minF])) minF++;
+            auto& byG = buckets[minF];
+            while (byG.back().empty()) byG.pop_back();
+            NodeId id = byG.back().back();
+            byG.back().pop_back();
+            count--;
+            return id;
+        }
+        bool empty() const { return count == 0; }
+        size_t size() const { return count; }
+        template <typename Visit>
+        void forEach(Visit&& visit) const {
+            for (const auto& byG : buckets)
+                for (const auto& ids : byG)
+                    for (NodeId id : ids) visit(id);
+        }
+
+    private:
+        static bool isEmptyF(std::vector<std::vector<NodeId>>& byG) {
+            while (!byG.empty() && byG.back().empty()) byG.pop_back();
+            return byG.empty();
+        }
+
+        std::vector<std::vector<std::vector<NodeId>>> buckets;
+        size_t minF = SIZE_MAX;
+        size_t count = 0;
+    };
+
+    // With move pruning, which successors a node generates depends on the
+    // context of its path as well as on its state, so one expansion of a
+    // state does not cover another path to it of the same cost. Paths of
+    // higher cost are still dropped: they are on no shortest path.
+    struct ClosedContext {
+        TopSpinStateSpace::TopSpinState state;
+        uint32_t context;
+        bool operator==(const ClosedContext& other) const { return context == other.context && state == other.state; }
+    };
+    struct ClosedContextHash {
+        size_t operator()(const ClosedContext& c) const {
+            return std::hash<TopSpinStateSpace::TopSpinState>()(c.state) ^ (c.context * 0x9E3779B97F4A7C15ull);
+        }
+    };
+    using ClosedContexts = std::unordered_set<ClosedContext, ClosedContextHash>;
+
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> extract_path(NodeId id) {
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> path;
+        while (id != NO_PARENT && nodes[id].parent != NO_PARENT) {
+            const Node& node = nodes[id];
+            path.push_back(TopSpinStateSpace::TopSpinActionStatePair(node.action, node.state));
+            id = node.parent;
+        }
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
+public:
+    TopSpinStateSpace stateSpace;
+
+    // Search on rotation-canonical states; see TopSpinStateSpace::canonicalize.
+    bool canonical = false;
+    // Move pruning over sequences of up to this many actions; 0 disables it.
+    // The table orders actions by absolute position, which canonicalization
+    // changes from state to state, so the two are not combined.
+    std::unique_ptr<topspin::MovePruning> pruning;
+    int pruneLength = 0;
+
+    // Checkpoints: every checkpointInterval seconds the open and closed lists
+    // and all search nodes are written to checkpointPath from a forked copy
+    // of the process (see topspin::BackgroundCheckpoint), replacing the
+    // previous checkpoint. With resume set, the search continues from the
+    // checkpoint instead of starting at the initial state, which must be the
+    // one stored in it.
+    std::string checkpointPath;
+    double checkpointInterval = 300.0;
+    bool resume = false;
+
+    AStarSearch(const TopSpinStateSpace::TopSpinState& initialState, bool canonical = false, int pruneLength = 0)
+        : stateSpace(initialState.size, initialState), canonical(canonical), pruneLength(pruneLength) {
+        if (pruneLength > 0 && !canonical)
+            pruning = std::make_unique<topspin::MovePruning>(stateSpace.n, initialState.k, pruneLength);
+    }
+
+    long getExpandedNodes() const { return expandedNodes; }
+
+    // Runs the search with the named open list, "heap" or "bucket".
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> solve(const std::string& heuristic, const std::string& openList = "heap") {
+        heuristicName = heuristic;
+        bucketOpenList = openList == "bucket";
+        return TopSpinStateSpace::withHeuristic(heuristic, [&](const auto& policy) {
+            return openList == "bucket"
+                ? run_Algorithm<BucketOpenList>(policy)
+                : run_Algorithm<HeapOpenList>(policy);
+        });
+    }
+
+    void runSearchAlgorithm(const std::string& heuristic, const std::string& openList = "heap") {
+        using namespace std::chrono;
+
+        auto timeStart = high_resolution_clock::now();
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> solution = solve(heuristic, openList);
+        auto timeEnd = high_resolution_clock::now();
+
+        TopSpinStateSpace::TopSpinState initialState = stateSpace.getInitialState();
+        int initial_h = stateSpace.h(initialState, heuristic);
+
+        std::cout << "Initial State: " << initialState << "| h = " << initial_h << std::endl;
+
+        double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+        std::cout << elapsedSeconds << " seconds search time" << std::endl;
+        std::cout << "Number of expanded nodes: " << expandedNodes << std::endl;
+        std::cout << "Allocated nodes: " << allocatedNodes << " (" << arenaChunks << " chunks, "
+             << arenaBytes / (1024 * 1024) << " MiB)" << std::endl;
+        topspin::printAbstractionCacheStats();
+
+        if (solution.empty()) {
+            std::cout << "No solution" << std::endl;
+        } else {
+            int totalCost = 0;
+            // Optional: Print the solution path
+            // Commented out for experimentation purposes
+            //std::cout << "Solution:" << std::endl;
+            for (const auto& pair : solution) {
+                //std::cout << "State: " << pair.state << "| h = " << stateSpace.h(pair.state, heuristic) << std::endl;
+                totalCost += pair.action.cost();
+            }
+            std::cout << "Solution length: " << solution.size() << std::endl;
+            std::cout << "Solution cost: " << totalCost << std::endl;
+            std::cout << "-----------------------------------------" << std::endl;
+        }
+    }
+
+private:
+    // Recorded by solve() for the checkpoint header.
+    std::string heuristicName;
+    bool bucketOpenList = false;
+
+    topspin::CheckpointHeader checkpointHeader() const {
+        topspin::CheckpointHeader header{};
+        header.kind = static_cast<uint8_t>(topspin::CheckpointKind::AStar);
+        header.n = static_cast<uint8_t>(stateSpace.n);
+        header.k = stateSpace.initialState.k;
+        header.canonical = canonical;
+        header.pruneLength = static_cast<uint8_t>(pruning ? pruneLength : 0);
+        header.openList = bucketOpenList;
+        return header;
+    }
+
+    // Nodes in id order, then the open ids, then the closed states and, with
+    // move pruning, the expanded (state, context) pairs.
+    template <typename OpenList>
+    bool writeCheckpoint(const OpenList& open, const std::unordered_map<TopSpinStateSpace::TopSpinState, int>& closed,
+                         const ClosedContexts& closedContexts) const {
+        topspin::CheckpointHeader header = checkpointHeader();
+        header.expanded = static_cast<uint64_t>(expandedNodes);
+        header.nodes = nodes.size();
+        header.open = open.size();
+        header.closed = closed.size();
+        header.closedContexts = closedContexts.size();
+        topspin::CheckpointWriter out;
+        if (!out.open(checkpointPath, header, heuristicName, stateSpace.initialState)) return false;
+        for (NodeId id = 0; id < nodes.size(); id++) {
+            const Node& node = nodes[id];
+            out.putState(node.state);
+            out.put(static_cast<int32_t>(node.action.rotate));
+            out.put(node.parent);
+            out.put(static_cast<int32_t>(node.cost));
+            out.put(static_cast<int32_t>(node.h));
+            out.put(static_cast<int32_t>(node.gaps));
+            out.put(node.context);
+        }
+        open.forEach([&](NodeId id) { out.put(id); });
+        for (const auto& [state, cost] : closed) {
+            out.putState(state);
+            out.put(static_cast<int32_t>(cost));
+        }
+        for (const ClosedContext& expanded : closedContexts) {
+            out.putState(expanded.state);
+            out.put(expanded.context);
+        }
+        return out.commit();
+    }
+
+    // Refills nodes, open and closed from checkpointPath. Fails if the
+    // checkpoint belongs to a different search.
+    template <typename OpenList>
+    bool restoreCheckpoint(OpenList& open, std::unordered_map<TopSpinStateSpace::TopSpinState, int>& closed,
+                           ClosedContexts& closedContexts) {
+        topspin::CheckpointReader in;
+        if (!in.open(checkpointPath)) return false;
+        const topspin::CheckpointHeader& header = in.header();
+        topspin::CheckpointHeader expected = checkpointHeader();
+        if (header.kind != expected.kind || header.n != expected.n || header.k != expected.k ||
+            header.canonical != expected.canonical || header.pruneLength != expected.pruneLength ||
+            header.openList != expected.openList || in.heuristic() != heuristicName ||
+            !(in.initialState() == stateSpace.initialState) || header.nodes >= NO_PARENT)
+            return false;
+
+        TopSpinStateSpace::TopSpinState state = stateSpace.initialState;
+        for (uint64_t i = 0; i < header.nodes; i++) {
+            int32_t rotate, cost, h, gaps;
+            NodeId parent;
+            uint32_t context;
+            if (!in.getState(state) || !in.get(rotate) || !in.get(parent) || !in.get(cost) ||
+                !in.get(h) || !in.get(gaps) || !in.get(context))
+                return false;
+            nodes.allocate(state, parent, TopSpinStateSpace::TopSpinAction(rotate), cost, h, gaps, context);
+        }
+        for (uint64_t i = 0; i < header.open; i++) {
+            NodeId id;
+            if (!in.get(id) || id >= nodes.size()) return false;
+            open.push(id, nodes[id].cost, nodes[id].h);
+        }
+        closed.reserve(header.closed);
+        for (uint64_t i = 0; i < header.closed; i++) {
+            int32_t cost;
+            if (!in.getState(state) || !in.get(cost)) return false;
+            closed.emplace(state, cost);
+        }
+        closedContexts.reserve(header.closedContexts);
+        for (uint64_t i = 0; i < header.closedContexts; i++) {
+            uint32_t context;
+            if (!in.getState(state) || !in.get(context)) return false;
+            closedContexts.insert({state, context});
+        }
+        expandedNodes = static_cast<long>(header.expanded);
+        return true;
+    }
+
+public:
+    template <typename OpenList, typename Heuristic>
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> run_Algorithm(const Heuristic& heuristic) {
+        OpenList open(nodes);
+        std::unordered_map<TopSpinStateSpace::TopSpinState, int> closed;
+        ClosedContexts closedContexts;
+
+        TopSpinStateSpace::TopSpinState initialState = stateSpace.getInitialState();
+        if (canonical) stateSpace.canonicalize(initialState);
+        int initial_gaps = heuristic.data(stateSpace, initialState);
+        int initial_h = heuristic.value(stateSpace, initialState, initial_gaps);
+
+        if (initial_h == INT_MAX)
+            return {};
+
+        if (resume) {
+            if (!restoreCheckpoint(open, closed, closedContexts)) {
+                std::cerr << "Could not resume from checkpoint " << checkpointPath << "\n";
+                nodes.clear();
+                return {};
+            }
+        } else {
+            uint32_t initial_context = pruning ? pruning->rootContext() : 0;
+            open.push(nodes.allocate(initialState, NO_PARENT, TopSpinStateSpace::TopSpinAction(-1), 0, initial_h, initial_gaps, initial_context), 0, initial_h);
+        }
+
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> path;
+        // h of every successor of the node being expanded, for batched policies.
+        std::vector<int> successorH(stateSpace.n);
+        topspin::BackgroundCheckpoint checkpoint;
+        auto lastCheckpoint = std::chrono::steady_clock::now();
+        uint64_t pops = 0;
+        bool outOfNodes = false;
+        while (!open.empty() && !outOfNodes) {
+            // Checkpoints are taken between expansions, where open and closed
+            // agree; the clock is read every 65536 iterations only.
+            if (!checkpointPath.empty() && (++pops & 0xFFFF) == 0 &&
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() >= checkpointInterval &&
+                !checkpoint.busy()) {
+                TOPSPIN_PROFILE_SCOPE("astar.checkpoint");
+                checkpoint.start([&] { return writeCheckpoint(open, closed, closedContexts); });
+                lastCheckpoint = std::chrono::steady_clock::now();
+            }
+            NodeId currentId;
+            {
+                TOPSPIN_PROFILE_SCOPE("astar.open.pop");
+                currentId = open.pop();
+            }
+            const Node& current = nodes[currentId];
+
+            {
+                TOPSPIN_PROFILE_SCOPE("astar.closed");
+                auto [entry, inserted] = closed.try_emplace(current.state, current.cost);
+                bool duplicate = !inserted;
+                if (pruning && (inserted || entry->second == current.cost))
+                    duplicate = !closedContexts.insert({current.state, current.context}).second;
+                if (duplicate) {
+                    TOPSPIN_PROFILE_COUNT("astar.duplicates", 1);
+                    continue;
+                }
+            }
+            if ((expandedNodes & 0xFFFF) == 0) {
+                TOPSPIN_PROFILE_SAMPLE("astar.openSize", expandedNodes, open.size());
+                TOPSPIN_PROFILE_SAMPLE("astar.closedSize", expandedNodes, closed.size());
+            }
+
+            if (stateSpace.is_Goal(current.state)) {
+                path = extract_path(currentId);
+                break;
+            }
+
+            auto successors = stateSpace.successors(current.state);
+            if constexpr (Heuristic::BATCHED) {
+                TOPSPIN_PROFILE_SCOPE("astar.heuristic");
+                heuristic.successorValues(stateSpace, current.state, canonical, -1, successorH.data());
+            }
+            int currentCost = current.cost;
+            int currentGaps = current.gaps;
+            uint32_t currentContext = current.context;
+            for (const auto& [action, succState] : successors) {
+                if (pruning && !pruning->allowed(currentContext, action.rotate)) continue;
+                TopSpinStateSpace::TopSpinState nextState = succState;
+                if (canonical) stateSpace.canonicalize(nextState);
+                uint32_t context = pruning ? pruning->next(currentContext, action.rotate) : 0;
+                int g = currentCost + action.cost();
+                // The gap policy updates the parent's gap count instead of
+                // rescanning every successor.
+                int gaps, h;
+                {
+                    TOPSPIN_PROFILE_SCOPE("astar.heuristic");
+                    gaps = heuristic.childData(stateSpace, nodes[currentId].state, currentGaps, action);
+                    if constexpr (Heuristic::BATCHED) h = successorH[action.rotate];
+                    else h = heuristic.value(stateSpace, nextState, gaps);
+                }
+                if (h == INT_MAX) continue;
+                TOPSPIN_PROFILE_COUNT("astar.generated", 1);
+                TOPSPIN_PROFILE_SCOPE("astar.open.push");
+                NodeId child = nodes.allocate(nextState, currentId, action, g, h, gaps, context);
+                if (child == NO_PARENT) {
+                    outOfNodes = true;
+                    break;
+                }
+                open.push(child, g, h);
+            }
+            expandedNodes++;
+        }
+        if (outOfNodes) std::cerr << "A* ran out of node ids after " << nodes.size() << " nodes\n";
+
+        allocatedNodes = nodes.size();
+        arenaChunks = nodes.chunkCount();
+        arenaBytes = nodes.bytesReserved();
+        nodes.clear();
+        return canonical ? stateSpace.restoreRotation(path) : path;
+    }
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "Abstraction.h"
+#include "AbstractionCache.h"
+#include "Profiling.h"
 
 #include <queue>
 #include <set>
@@ -20,7 +22,6 @@ struct VecHash {
         return h;
     }
 };
-static std::unordered_map<State, int, VecHash> solutionLengthCache;
 
 std::vector<uint8_t> abstract_state(const std::vector<uint8_t>& input, const std::function<bool(const uint8_t&)>& predicate) {
     std::vector<uint8_t> abstraction;
@@ -99,14 +100,21 @@ std::vector<uint8_t> reverseWindow(const std::vector<uint8_t>& state, int pos, i
 }
 
 template<typename GoalFunc>
-int getSolutionLengthGeneric(const std::vector<uint8_t>& abstraction, int k, GoalFunc is_goal_func, int mode) {
+int getSolutionLengthGeneric(const std::vector<uint8_t>& abstraction, int k, GoalFunc is_goal_func, int mode, uint32_t space) {
     State key = normalize(abstraction);
 
-    auto it = solutionLengthCache.find(key);
-    if (it != solutionLengthCache.end()) return it->second;
+    AbstractionCache& cache = abstractionCache();
+    AbstractionCache::Key cacheKey = AbstractionCache::makeKey(space, key);
+    int cached;
+    if (cache.find(cacheKey, cached)) {
+        TOPSPIN_PROFILE_COUNT("abstraction.cache.hits", 1);
+        return cached;
+    }
+    TOPSPIN_PROFILE_COUNT("abstraction.cache.misses", 1);
+    TOPSPIN_PROFILE_SCOPE("abstraction.bfs");
 
     if (is_goal_func(key)) {
-        solutionLengthCache[key] = 0;
+        cache.insert(cacheKey, 0);
         return 0;
     }
 
@@ -121,6 +129,7 @@ int getSolutionLengthGeneric(const std::vector<uint8_t>& abstraction, int k, Goa
     while (!q.empty()) {
         auto [current, depth] = q.front();
         q.pop();
+        TOPSPIN_PROFILE_COUNT("abstraction.bfsNodes", 1);
 
         for (int pos = 0; pos < n; pos++) {
             if (mode == 1 && !non_zero(current, pos, n, k)) continue;
@@ -130,24 +139,24 @@ int getSolutionLengthGeneric(const std::vector<uint8_t>& abstraction, int k, Goa
 
             if (is_goal_func(next)) {
                 int goal_depth = depth + 1;
-                solutionLengthCache[key] = goal_depth;
+                cache.insert(cacheKey, goal_depth);
                 return goal_depth;
             }
             q.push({std::move(next), depth + 1});
         }
     }
-    solutionLengthCache[key] = -1;
+    cache.insert(cacheKey, -1);
     return -1;
 }
 
-int getSolutionLength(const std::vector<uint8_t>& abstraction, int k) {
-    return getSolutionLengthGeneric(abstraction, k, is_goal, 1);
+int getSolutionLength(const std::vector<uint8_t>& abstraction, int k, uint32_t space) {
+    return getSolutionLengthGeneric(abstraction, k, is_goal, 1, space);
 }
 
-int getSolutionLengthC(const std::vector<uint8_t>& abstraction, int k, const std::function<int(uint8_t)>& mapping) {
+int getSolutionLengthC(const std::vector<uint8_t>& abstraction, int k, const std::function<int(uint8_t)>& mapping, uint32_t space) {
     return getSolutionLengthGeneric(abstraction, k, [&](const std::vector<uint8_t>& state) {
         return is_goalC(state, mapping);
-    }, 0);
+    }, 0, space);
 }
 
 } // namespace topspin
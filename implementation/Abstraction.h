@@ -13,11 +13,12 @@ bool is_goal(const std::vector<uint8_t>& abstraction);
 std::vector<uint8_t> subvec_wraparound(const std::vector<uint8_t>& vec, int pos, int len);
 bool non_zero(const std::vector<uint8_t>& state, int pos, int n, int k);
 std::vector<uint8_t> reverseWindow(const std::vector<uint8_t>& state, int pos, int k);
-int getSolutionLength(const std::vector<uint8_t>& abstraction, int k);
+// space separates the cached distances of different abstractions and k; see AbstractionCache.
+int getSolutionLength(const std::vector<uint8_t>& abstraction, int k, uint32_t space);
 
 std::vector<uint8_t> abstract_stateC(const std::vector<uint8_t>& input, const std::function<int(const uint8_t&)>& mapping);
 bool is_goalC(const std::vector<uint8_t>& abstraction, const std::function<int(uint8_t)>& mapping);
-int getSolutionLengthC(const std::vector<uint8_t>& abstraction, int k, const std::function<int(uint8_t)>& mapping);
+int getSolutionLengthC(const std::vector<uint8_t>& abstraction, int k, const std::function<int(uint8_t)>& mapping, uint32_t space);
 
 
 } // namespace topspin
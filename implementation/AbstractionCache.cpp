@@ -0,0 +1,160 @@
+#include "AbstractionCache.h"
+
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+
+namespace topspin {
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+struct KeyHash {
+    size_t operator()(const AbstractionCache::Key& key) const noexcept {
+        return static_cast<size_t>(key.lo);
+    }
+};
+
+struct AbstractionCache::Shard {
+    struct Slot {
+        Key key;
+        int32_t value;
+        bool used;
+        bool referenced;
+    };
+
+    std::mutex lock;
+    std::vector<Slot> slots;
+    std::unordered_map<Key, uint32_t, KeyHash> index;
+    size_t hand = 0;
+    size_t used = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    void reset(size_t capacity) {
+        slots.assign(capacity, Slot{{0, 0}, 0, false, false});
+        index.clear();
+        index.reserve(capacity);
+        hand = 0;
+        used = 0;
+    }
+
+    // Finds a free slot, evicting the first unreferenced one the clock hand
+    // passes over once every slot is in use.
+    uint32_t claim() {
+        if (used < slots.size()) return static_cast<uint32_t>(used++);
+        while (true) {
+            Slot& slot = slots[hand];
+            uint32_t position = static_cast<uint32_t>(hand);
+            hand = (hand + 1) % slots.size();
+            if (slot.referenced) {
+                slot.referenced = false;
+                continue;
+            }
+            index.erase(slot.key);
+            evictions++;
+            return position;
+        }
+    }
+};
+
+AbstractionCache::AbstractionCache(size_t maxBytes, int numShards) {
+    for (int i = 0; i < std::max(1, numShards); i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    setLimit(maxBytes);
+}
+
+AbstractionCache::~AbstractionCache() = default;
+
+AbstractionCache::Key AbstractionCache::makeKey(uint32_t space, const std::vector<uint8_t>& state) {
+    uint64_t lo = mix(0x9e3779b97f4a7c15ULL ^ space);
+    uint64_t hi = mix(0xc2b2ae3d27d4eb4fULL ^ (static_cast<uint64_t>(space) << 32) ^ state.size());
+    for (size_t i = 0; i < state.size(); i += 8) {
+        uint64_t word = 0;
+        for (size_t j = i; j < std::min(i + 8, state.size()); j++) {
+            word |= static_cast<uint64_t>(state[j]) << (8 * (j - i));
+        }
+        lo = mix(lo ^ word);
+        hi = mix(hi + word * 0x9e3779b97f4a7c15ULL);
+    }
+    return {lo, hi};
+}
+
+bool AbstractionCache::find(const Key& key, int& value) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+    Shard::Slot& slot = shard.slots[it->second];
+    slot.referenced = true;
+    value = slot.value;
+    shard.hits++;
+    return true;
+}
+
+void AbstractionCache::insert(const Key& key, int value) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (shard.slots.empty()) return;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.slots[it->second].value = value;
+        return;
+    }
+    uint32_t position = shard.claim();
+    shard.slots[position] = {key, value, true, false};
+    shard.index.emplace(key, position);
+}
+
+void AbstractionCache::setLimit(size_t maxBytes) {
+    size_t perShard = maxBytes / ENTRY_BYTES / shards.size();
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->reset(perShard);
+    }
+}
+
+AbstractionCache::Stats AbstractionCache::stats() const {
+    Stats total;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total.hits += shard->hits;
+        total.misses += shard->misses;
+        total.evictions += shard->evictions;
+        total.entries += shard->index.size();
+        total.capacity += shard->slots.size();
+    }
+    return total;
+}
+
+AbstractionCache& abstractionCache() {
+    static AbstractionCache cache([] {
+        const char* megabytes = std::getenv("TOPSPIN_CACHE_MB");
+        size_t mb = megabytes ? std::strtoull(megabytes, nullptr, 10) : 256;
+        return mb * 1024 * 1024;
+    }());
+    return cache;
+}
+
+void printAbstractionCacheStats() {
+    AbstractionCache::Stats cache = abstractionCache().stats();
+    if (cache.hits + cache.misses == 0) return;
+    std::cout << "Abstraction cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+              << cache.evictions << " evictions, " << cache.entries << "/" << cache.capacity << " entries" << std::endl;
+}
+
+} // namespace topspin
@@ -0,0 +1,67 @@
+#ifndef TOPSPIN_ABSTRACTION_CACHE_H
+#define TOPSPIN_ABSTRACTION_CACHE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace topspin {
+
+// Bounded cache of abstract solution lengths shared by all threads. Entries
+// are spread over independently locked shards; each shard holds a fixed number
+// of slots and evicts with the CLOCK algorithm once it is full.
+class AbstractionCache {
+public:
+    // 128-bit fingerprint of an abstraction namespace and an abstract state.
+    struct Key {
+        uint64_t lo;
+        uint64_t hi;
+        bool operator==(const Key& other) const { return lo == other.lo && hi == other.hi; }
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t capacity = 0;
+    };
+
+    // Approximate memory used per cached entry, slot and index together.
+    static constexpr size_t ENTRY_BYTES = 64;
+
+    explicit AbstractionCache(size_t maxBytes, int shards = 64);
+    ~AbstractionCache();
+    AbstractionCache(const AbstractionCache&) = delete;
+    AbstractionCache& operator=(const AbstractionCache&) = delete;
+
+    // Namespaces keep abstractions whose states look alike apart, e.g. the
+    // labels of a compressed group and a compressed mod abstraction.
+    static Key makeKey(uint32_t space, const std::vector<uint8_t>& state);
+
+    bool find(const Key& key, int& value);
+    void insert(const Key& key, int value);
+
+    // Drops all entries and resizes the shards to the new limit.
+    void setLimit(size_t maxBytes);
+    Stats stats() const;
+
+private:
+    struct Shard;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    Shard& shardOf(const Key& key) const { return *shards[key.hi % shards.size()]; }
+};
+
+// Shared cache used by getSolutionLength; its size defaults to
+// $TOPSPIN_CACHE_MB megabytes, or 256 MB.
+AbstractionCache& abstractionCache();
+
+// Prints the statistics of abstractionCache() to stdout, or nothing if no
+// search has looked anything up in it.
+void printAbstractionCacheStats();
+
+} // namespace topspin
+
+#endif // TOPSPIN_ABSTRACTION_CACHE_H
@@ -0,0 +1,260 @@
+#include "AStarSearch.h"
+#include "IDAStarSearch.h"
+#include "BidirectionalSearch.h"
+#include "ExternalSearch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <climits>
+#include <chrono>
+#include <random>
+#include <charconv>
+#include <numeric>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// One line of the instance file. Either a scramble spec "n k m seed", which
+// applies m random reversals chosen by mt19937(seed) to the goal, or an
+// explicit state "n k : t1 t2 ... tn".
+struct Instance {
+    int id = 0;
+    int n = 0;
+    int k = 0;
+    int m = -1;
+    uint64_t seed = 0;
+    vector<uint8_t> permutation;
+};
+
+struct Result {
+    int id;
+    string initialState;
+    int h;
+    double seconds;
+    long long nodesExpanded;
+    bool solved;
+    size_t solutionLength;
+    int totalCost;
+};
+
+TopSpinStateSpace::TopSpinState createState(const Instance& instance) {
+    if (!instance.permutation.empty()) {
+        return TopSpinStateSpace::TopSpinState(instance.permutation, instance.k);
+    }
+    vector<uint8_t> permutation(instance.n);
+    iota(permutation.begin(), permutation.end(), 1);
+    TopSpinStateSpace::TopSpinState state(permutation, instance.k);
+
+    mt19937_64 rng(instance.seed);
+    uniform_int_distribution<int> dist(0, instance.n - 1);
+    for (int i = 0; i < instance.m; i++) {
+        TopSpinStateSpace::TopSpinAction action(dist(rng));
+        action.apply(state);
+    }
+    return state;
+}
+
+// Parses the whole of text as a decimal number.
+template <typename T>
+bool parseNumber(const string& text, T& value) {
+    const char* end = text.data() + text.size();
+    auto [last, error] = from_chars(text.data(), end, value);
+    return error == errc() && last == end;
+}
+
+bool readInstances(const string& path, vector<Instance>& instances) {
+    ifstream in(path);
+    if (!in) {
+        cerr << "Could not open instance file " << path << endl;
+        return false;
+    }
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        Instance instance;
+        instance.id = static_cast<int>(instances.size());
+        istringstream fields(line);
+        string token;
+        if (!(fields >> instance.n >> instance.k >> token)) {
+            cerr << path << ":" << lineNumber << ": expected 'n k m seed' or 'n k : tokens'" << endl;
+            return false;
+        }
+        if (instance.n < 2 || instance.n > UINT8_MAX || instance.k < 2 || instance.k > instance.n) {
+            cerr << path << ":" << lineNumber << ": need 2 <= k <= n <= " << UINT8_MAX << endl;
+            return false;
+        }
+        if (token == ":") {
+            // Every token must occur once; anything else is no TopSpin state.
+            vector<bool> seen(instance.n + 1);
+            int value;
+            while (fields >> value) {
+                if (value < 1 || value > instance.n || seen[value]) {
+                    cerr << path << ":" << lineNumber << ": tokens must be a permutation of 1.." << instance.n << endl;
+                    return false;
+                }
+                seen[value] = true;
+                instance.permutation.push_back(static_cast<uint8_t>(value));
+            }
+            if (static_cast<int>(instance.permutation.size()) != instance.n || !fields.eof()) {
+                cerr << path << ":" << lineNumber << ": expected " << instance.n << " tokens" << endl;
+                return false;
+            }
+        } else {
+            if (!parseNumber(token, instance.m) || instance.m < 0) {
+                cerr << path << ":" << lineNumber << ": m must be a non-negative number, not '" << token << "'" << endl;
+                return false;
+            }
+            string seed;
+            if (!(fields >> seed)) {
+                instance.seed = instance.id;
+            } else if (!parseNumber(seed, instance.seed)) {
+                cerr << path << ":" << lineNumber << ": seed must be a non-negative number, not '" << seed << "'" << endl;
+                return false;
+            }
+            string extra;
+            if (fields >> extra) {
+                cerr << path << ":" << lineNumber << ": unexpected '" << extra << "' after the seed" << endl;
+                return false;
+            }
+        }
+        instances.push_back(std::move(instance));
+    }
+    return true;
+}
+
+Result solve(const Instance& instance, const string& algorithm, const string& heuristic) {
+    using namespace std::chrono;
+
+    TopSpinStateSpace::TopSpinState initialState = createState(instance);
+    Result result{instance.id, "", 0, 0.0, 0, false, 0, 0};
+    ostringstream state;
+    state << initialState;
+    result.initialState = state.str();
+    if (!result.initialState.empty()) result.initialState.pop_back();
+
+    vector<TopSpinStateSpace::TopSpinActionStatePair> solution;
+    auto timeStart = high_resolution_clock::now();
+    if (algorithm == "idastar") {
+        IDAStarSearch search(initialState);
+        result.h = search.stateSpace.h(initialState, heuristic);
+        solution = search.run_Algorithm(heuristic);
+        result.nodesExpanded = search.nodesExpanded;
+        result.solved = search.solved;
+    } else if (algorithm == "bidirectional") {
+        BidirectionalSearch search(initialState);
+        result.h = search.stateSpace.h(initialState, heuristic);
+        solution = search.solve(heuristic);
+        result.nodesExpanded = search.getExpandedNodes();
+        result.solved = !solution.empty() || search.stateSpace.is_Goal(initialState);
+    } else if (algorithm == "external") {
+        ExternalSearch search(initialState);
+        result.h = search.stateSpace.h(initialState, heuristic);
+        solution = search.solve(heuristic);
+        result.nodesExpanded = search.nodesExpanded;
+        result.solved = !search.storageFailed && (!solution.empty() || search.stateSpace.is_Goal(initialState));
+    } else {
+        AStarSearch search(initialState);
+        result.h = search.stateSpace.h(initialState, heuristic);
+        solution = search.solve(heuristic, algorithm == "astar-bucket" ? "bucket" : "heap");
+        result.nodesExpanded = search.getExpandedNodes();
+        result.solved = !solution.empty() || search.stateSpace.is_Goal(initialState);
+    }
+    auto timeEnd = high_resolution_clock::now();
+
+    result.seconds = duration<double>(timeEnd - timeStart).count();
+    result.solutionLength = solution.size();
+    for (const auto& pair : solution) result.totalCost += pair.action.cost();
+    return result;
+}
+
+// Quotes a CSV field that contains a comma, as composite heuristic names do.
+string csvField(const string& field) {
+    return field.find(',') == string::npos ? field : "\"" + field + "\"";
+}
+
+void writeHeader(ostream& out, const string& format) {
+    if (format == "csv") {
+        out << "id,n,k,algorithm,heuristic,initial_state,h,time_s,nodes_expanded,solved,solution_length,total_cost\n";
+    }
+}
+
+void writeResult(ostream& out, const string& format, const Instance& instance,
+                 const string& algorithm, const string& heuristic, const Result& result) {
+    if (format == "jsonl") {
+        out << "{\"id\":" << result.id << ",\"n\":" << instance.n << ",\"k\":" << instance.k
+            << ",\"algorithm\":\"" << algorithm << "\",\"heuristic\":\"" << heuristic
+            << "\",\"initial_state\":\"" << result.initialState << "\",\"h\":" << result.h
+            << ",\"time_s\":" << result.seconds << ",\"nodes_expanded\":" << result.nodesExpanded
+            << ",\"solved\":" << (result.solved ? "true" : "false")
+            << ",\"solution_length\":" << result.solutionLength
+            << ",\"total_cost\":" << result.totalCost << "}\n";
+    } else {
+        out << result.id << "," << instance.n << "," << instance.k << "," << algorithm << ","
+            << csvField(heuristic) << "," << result.initialState << "," << result.h << ","
+            << result.seconds << "," << result.nodesExpanded << "," << (result.solved ? 1 : 0) << ","
+            << result.solutionLength << "," << result.totalCost << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " instances algorithm h [threads=T] [format=csv|jsonl] [out=path]\n"
+                  << "  algorithm: astar, astar-bucket, idastar, bidirectional or external\n";
+        return 1;
+    }
+
+    string instanceFile = argv[1];
+    string algorithm = argv[2];
+    string heuristic = argv[3];
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    string format = "csv";
+    string outPath;
+    for (int i = 4; i < argc; i++) {
+        string option = argv[i];
+        if (option.rfind("threads=", 0) == 0) threads = std::atoi(option.c_str() + 8);
+        else if (option.rfind("format=", 0) == 0) format = option.substr(7);
+        else if (option.rfind("out=", 0) == 0) outPath = option.substr(4);
+    }
+    threads = max(1, threads);
+
+    vector<Instance> instances;
+    if (!readInstances(instanceFile, instances)) return 1;
+
+    ofstream file;
+    if (!outPath.empty()) {
+        file.open(outPath);
+        if (!file) {
+            std::cerr << "Could not open output file " << outPath << "\n";
+            return 1;
+        }
+    }
+    ostream& out = outPath.empty() ? cout : file;
+    writeHeader(out, format);
+
+    // Instances are handed out in file order; results are written as they
+    // complete. Pattern databases are shared between the workers, so each one
+    // is built or mapped once per (n, k).
+    atomic<size_t> next{0};
+    mutex outLock;
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            for (size_t i = next++; i < instances.size(); i = next++) {
+                Result result = solve(instances[i], algorithm, heuristic);
+                lock_guard<mutex> guard(outLock);
+                writeResult(out, format, instances[i], algorithm, heuristic, result);
+            }
+        });
+    }
+    for (thread& worker : workers) worker.join();
+    out.flush();
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "AStarSearch.h"
+#include "IDAStarSearch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <cstdint>
+
+using namespace std;
+
+#ifndef TOPSPIN_BUILD_TYPE
+#define TOPSPIN_BUILD_TYPE "manual"
+#endif
+
+// Bumped whenever a field changes meaning, so results of different versions
+// are only compared when they measure the same thing.
+static const int SCHEMA_VERSION = 1;
+
+struct Measurement {
+    string name;
+    long long calls = 0;
+    double seconds = 0.0;
+    long long checksum = 0;
+};
+
+struct SearchRun {
+    string algorithm;
+    string heuristic;
+    int n, k, m;
+    uint64_t seed;
+    double seconds = 0.0;
+    long long expanded = 0;
+    size_t length = 0;
+    bool solved = false;
+};
+
+TopSpinStateSpace::TopSpinState seededState(int n, int k, int m, uint64_t seed) {
+    vector<uint8_t> permutation(n);
+    iota(permutation.begin(), permutation.end(), 1);
+    TopSpinStateSpace::TopSpinState state(permutation, k);
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> dist(0, n - 1);
+    for (int i = 0; i < m; i++) TopSpinStateSpace::TopSpinAction(dist(rng)).apply(state);
+    return state;
+}
+
+// Results of the timed calls end up here so the work cannot be optimized away.
+static volatile long long sink = 0;
+
+// Calls run(i) for i = 0, 1, ... in batches until minSeconds have passed. The
+// checksum is the sum of the first batch, so it only changes with the results.
+template <typename Run>
+Measurement timeCalls(const string& name, double minSeconds, long long batch, Run run) {
+    using namespace std::chrono;
+    Measurement measurement;
+    measurement.name = name;
+    long long sum = 0;
+    auto timeStart = steady_clock::now();
+    do {
+        for (long long i = 0; i < batch; i++) sum += run(measurement.calls + i);
+        if (measurement.calls == 0) measurement.checksum = sum;
+        measurement.calls += batch;
+        measurement.seconds = duration<double>(steady_clock::now() - timeStart).count();
+    } while (measurement.seconds < minSeconds);
+    sink = sink + sum;
+    return measurement;
+}
+
+vector<Measurement> microBenchmarks(int n, int k, int stateCount, double minSeconds, uint64_t seed) {
+    vector<TopSpinStateSpace::TopSpinState> states;
+    vector<vector<uint8_t>> permutations;
+    for (int i = 0; i < stateCount; i++) {
+        states.push_back(seededState(n, k, 10 * n, seed + i));
+        permutations.push_back(states.back().permutation());
+    }
+    TopSpinStateSpace stateSpace(n, states[0]);
+    vector<Measurement> results;
+
+    for (const string& name : TopSpinStateSpace::heuristicNames()) {
+        TopSpinStateSpace::HeuristicFunc function = TopSpinStateSpace::resolveHeuristic(name);
+        // Builds or maps the pattern databases before anything is timed.
+        function(permutations[0], k);
+        results.push_back(timeCalls("heuristic/" + name, minSeconds, stateCount, [&](long long i) {
+            return function(permutations[i % stateCount], k);
+        }));
+    }
+
+    TopSpinStateSpace::TopSpinState state = states[0];
+    results.push_back(timeCalls("apply", minSeconds, 1 << 16, [&](long long i) {
+        TopSpinStateSpace::TopSpinAction(static_cast<int>(i % n)).apply(state);
+        return static_cast<long long>(state.token(0));
+    }));
+
+    results.push_back(timeCalls("successors", minSeconds, stateCount, [&](long long i) {
+        auto successors = stateSpace.successors(states[i % stateCount]);
+        return static_cast<long long>(successors.back().state.token(0));
+    }));
+    return results;
+}
+
+vector<SearchRun> macroBenchmarks(const vector<string>& heuristics, uint64_t seed) {
+    using namespace std::chrono;
+    // Walk lengths well past the diameter of the smaller puzzles, so the
+    // starts are close to uniformly random.
+    struct Instance { int n, k, m; uint64_t seed; };
+    vector<Instance> corpus;
+    for (int i = 0; i < 4; i++) corpus.push_back({12, 4, 100, seed + i});
+    for (int i = 0; i < 4; i++) corpus.push_back({14, 4, 100, seed + 100 + i});
+
+    vector<SearchRun> runs;
+    for (const string& heuristic : heuristics) {
+        for (const Instance& instance : corpus) {
+            TopSpinStateSpace::TopSpinState initialState = seededState(instance.n, instance.k, instance.m, instance.seed);
+            for (const char* algorithm : {"astar", "idastar"}) {
+                SearchRun run{algorithm, heuristic, instance.n, instance.k, instance.m, instance.seed};
+                auto timeStart = steady_clock::now();
+                vector<TopSpinStateSpace::TopSpinActionStatePair> solution;
+                if (run.algorithm == "astar") {
+                    AStarSearch search(initialState, true);
+                    solution = search.solve(heuristic);
+                    run.expanded = search.getExpandedNodes();
+                    run.solved = !solution.empty() || search.stateSpace.is_Goal(initialState);
+                } else {
+                    IDAStarSearch search(initialState, true);
+                    solution = search.run_Algorithm(heuristic);
+                    run.expanded = search.nodesExpanded;
+                    run.solved = search.solved;
+                }
+                run.seconds = duration<double>(steady_clock::now() - timeStart).count();
+                run.length = solution.size();
+                runs.push_back(run);
+            }
+        }
+    }
+    return runs;
+}
+
+void writeJson(ostream& out, int n, int k, uint64_t seed, const vector<Measurement>& micro, const vector<SearchRun>& macro) {
+    out << "{\n  \"schema\": " << SCHEMA_VERSION << ",\n"
+        << "  \"build_type\": \"" << TOPSPIN_BUILD_TYPE << "\",\n"
+        << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+        << "  \"micro_n\": " << n << ", \"micro_k\": " << k << ", \"seed\": " << seed << ",\n"
+        << "  \"micro\": [";
+    for (size_t i = 0; i < micro.size(); i++) {
+        const Measurement& m = micro[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << m.name << "\", \"calls\": " << m.calls
+            << ", \"seconds\": " << m.seconds << ", \"ns_per_call\": " << 1e9 * m.seconds / m.calls
+            << ", \"checksum\": " << m.checksum << "}";
+    }
+    out << "\n  ],\n  \"macro\": [";
+    for (size_t i = 0; i < macro.size(); i++) {
+        const SearchRun& r = macro[i];
+        out << (i ? ",\n" : "\n") << "    {\"algorithm\": \"" << r.algorithm << "\", \"heuristic\": \"" << r.heuristic
+            << "\", \"n\": " << r.n << ", \"k\": " << r.k << ", \"m\": " << r.m << ", \"seed\": " << r.seed
+            << ", \"seconds\": " << r.seconds << ", \"nodes_expanded\": " << r.expanded
+            << ", \"solved\": " << (r.solved ? "true" : "false") << ", \"solution_length\": " << r.length << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    int n = 12;
+    int k = 4;
+    int stateCount = 1024;
+    double minSeconds = 0.2;
+    uint64_t seed = 1;
+    vector<string> heuristics{"gap"};
+    bool micro = true;
+    bool macro = true;
+    string outPath;
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        if (option.rfind("n=", 0) == 0) n = std::atoi(option.c_str() + 2);
+        else if (option.rfind("k=", 0) == 0) k = std::atoi(option.c_str() + 2);
+        else if (option.rfind("states=", 0) == 0) stateCount = std::max(1, std::atoi(option.c_str() + 7));
+        else if (option.rfind("time=", 0) == 0) minSeconds = std::atof(option.c_str() + 5);
+        else if (option.rfind("seed=", 0) == 0) seed = std::strtoull(option.c_str() + 5, nullptr, 10);
+        else if (option.rfind("out=", 0) == 0) outPath = option.substr(4);
+        else if (option == "micro") macro = false;
+        else if (option == "macro") micro = false;
+        else if (option.rfind("h=", 0) == 0) {
+            heuristics.clear();
+            stringstream names(option.substr(2));
+            for (string name; getline(names, name, ';');) heuristics.push_back(name);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [micro|macro] [n=N] [k=K] [states=S] [time=seconds]"
+                      << " [seed=S] [h=h1;h2;...] [out=path]\n";
+            return 1;
+        }
+    }
+
+    vector<Measurement> microResults;
+    vector<SearchRun> macroResults;
+    if (micro) microResults = microBenchmarks(n, k, stateCount, minSeconds, seed);
+    if (macro) macroResults = macroBenchmarks(heuristics, seed);
+
+    if (outPath.empty()) {
+        writeJson(cout, n, k, seed, microResults, macroResults);
+    } else {
+        ofstream out(outPath);
+        if (!out) {
+            std::cerr << "Cannot open " << outPath << "\n";
+            return 1;
+        }
+        writeJson(out, n, k, seed, microResults, macroResults);
+    }
+    return 0;
+}
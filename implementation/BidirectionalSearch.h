@@ -0,0 +1,273 @@
+#ifndef BIDIRECTIONALSEARCH_H
+#define BIDIRECTIONALSEARCH_H
+
+#include "TopSpinStateSpace.h"
+#include "AbstractionCache.h"
+#include <queue>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <climits>
+#include <unordered_map>
+#include <chrono>
+#include <iostream>
+#include <cstdint>
+
+// Front-to-end bidirectional search that meets in the middle (MM). The forward
+// search runs from the start towards the goal and the backward search from the
+// goal towards the start, both on rotation-canonical states, where the goal is
+// a single state and every move is still its own inverse. The backward
+// heuristic evaluates the forward one on the state relabelled by the start
+// permutation: relabelling commutes with the moves and maps the start onto the
+// identity, so it keeps every distance.
+//
+// Both sides order their open lists by max(f, 2g), so neither expands a node
+// beyond half of the optimal cost, and the side with the smaller minimum goes
+// next. The search stops once the cheapest meeting found, U, is no larger than
+// max(C, fminF, fminB, gminF + gminB + 1), where C is the smaller minimum
+// priority. That is a lower bound on every path not found yet, so the result is
+// optimal for admissible heuristics; states whose g improves are reopened.
+class BidirectionalSearch {
+private:
+    struct Entry {
+        TopSpinStateSpace::TopSpinState state;
+        int g;
+        int f;
+        int priority;
+        // Heuristic policy data, see TopSpinStateSpace::GapPolicy.
+        int data;
+    };
+
+    struct CompareEntries {
+        bool operator()(const Entry& a, const Entry& b) const {
+            if (a.priority != b.priority) return a.priority > b.priority;
+            return a.g > b.g;
+        }
+    };
+
+    // Best known g of a generated state and the move it was reached with.
+    struct Record {
+        int g;
+        bool closed;
+        TopSpinStateSpace::TopSpinState parent;
+        int action;
+    };
+
+    struct Side {
+        std::priority_queue<Entry, std::vector<Entry>, CompareEntries> open;
+        std::unordered_map<TopSpinStateSpace::TopSpinState, Record> nodes;
+        // Open entries per g and per f, stale ones included, so the minima
+        // read from them are never too high.
+        std::vector<long long> openByG;
+        std::vector<long long> openByF;
+        long expanded = 0;
+
+        static void count(std::vector<long long>& counts, int value, int delta) {
+            if (value >= static_cast<int>(counts.size())) counts.resize(value + 1, 0);
+            counts[value] += delta;
+        }
+
+        static int minimum(const std::vector<long long>& counts) {
+            for (size_t value = 0; value < counts.size(); value++) {
+                if (counts[value] > 0) return static_cast<int>(value);
+            }
+            return INT_MAX / 4;
+        }
+
+        void push(const TopSpinStateSpace::TopSpinState& state, int g, int f, int data) {
+            count(openByG, g, 1);
+            count(openByF, f, 1);
+            open.push({state, g, f, std::max(f, 2 * g), data});
+        }
+
+        Entry pop() {
+            Entry entry = open.top();
+            open.pop();
+            count(openByG, entry.g, -1);
+            count(openByF, entry.f, -1);
+            return entry;
+        }
+
+        int gMin() const { return minimum(openByG); }
+        int fMin() const { return minimum(openByF); }
+    };
+
+    Side forward;
+    Side backward;
+
+    TopSpinStateSpace::TopSpinState relabel(const TopSpinStateSpace::TopSpinState& state,
+                                            const std::vector<uint8_t>& labelOf) const {
+        TopSpinStateSpace::TopSpinState relabelled = state;
+        for (int i = 0; i < state.size; i++) relabelled.setToken(i, labelOf[state.token(i)]);
+        return relabelled;
+    }
+
+    // The action that leads from state to the canonical state target.
+    int actionTo(const TopSpinStateSpace::TopSpinState& state, const TopSpinStateSpace::TopSpinState& target) const {
+        for (const auto& action : stateSpace.actions) {
+            TopSpinStateSpace::TopSpinState next = state;
+            action.apply(next);
+            stateSpace.canonicalize(next);
+            if (next == target) return action.rotate;
+        }
+        return -1;
+    }
+
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> extract_path(const TopSpinStateSpace::TopSpinState& start,
+                                                                        const TopSpinStateSpace::TopSpinState& goal,
+                                                                        const TopSpinStateSpace::TopSpinState& meet) const {
+        std::vector<int> moves;
+        for (TopSpinStateSpace::TopSpinState state = meet; !(state == start);) {
+            const Record& record = forward.nodes.at(state);
+            moves.push_back(record.action);
+            state = record.parent;
+        }
+        std::reverse(moves.begin(), moves.end());
+        for (TopSpinStateSpace::TopSpinState state = meet; !(state == goal);) {
+            const Record& record = backward.nodes.at(state);
+            moves.push_back(actionTo(state, record.parent));
+            state = record.parent;
+        }
+
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> path;
+        TopSpinStateSpace::TopSpinState state = start;
+        for (int move : moves) {
+            TopSpinStateSpace::TopSpinAction action(move);
+            action.apply(state);
+            stateSpace.canonicalize(state);
+            path.emplace_back(action, state);
+        }
+        return stateSpace.restoreRotation(path);
+    }
+
+public:
+    TopSpinStateSpace stateSpace;
+
+    BidirectionalSearch(const TopSpinStateSpace::TopSpinState& initialState)
+        : stateSpace(initialState.size, initialState) {}
+
+    long getExpandedNodes() const { return forward.expanded + backward.expanded; }
+    long getForwardExpanded() const { return forward.expanded; }
+    long getBackwardExpanded() const { return backward.expanded; }
+
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> solve(const std::string& heuristic) {
+        return TopSpinStateSpace::withHeuristic(heuristic, [&](const auto& policy) {
+            return run_Algorithm(policy);
+        });
+    }
+
+    template <typename Heuristic>
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> run_Algorithm(const Heuristic& heuristic) {
+        forward = Side();
+        backward = Side();
+
+        TopSpinStateSpace::TopSpinState start = stateSpace.getInitialState();
+        stateSpace.canonicalize(start);
+        std::vector<uint8_t> identity(stateSpace.n);
+        for (int i = 0; i < stateSpace.n; i++) identity[i] = static_cast<uint8_t>(i + 1);
+        TopSpinStateSpace::TopSpinState goal(identity, start.k);
+        if (start == goal) return {};
+
+        // Backward distances are distances to the start, which the relabelling
+        // turns into distances to the identity.
+        std::vector<uint8_t> labelOf(stateSpace.n + 1);
+        for (int i = 0; i < stateSpace.n; i++) labelOf[start.token(i)] = static_cast<uint8_t>(i + 1);
+        // The heuristic sees backward states relabelled.
+        auto view = [&](const TopSpinStateSpace::TopSpinState& state, bool isForward) {
+            return isForward ? state : relabel(state, labelOf);
+        };
+
+        TopSpinStateSpace::TopSpinState goalView = view(goal, false);
+        int startData = heuristic.data(stateSpace, start);
+        int goalData = heuristic.data(stateSpace, goalView);
+        int startH = heuristic.value(stateSpace, start, startData);
+        int goalH = heuristic.value(stateSpace, goalView, goalData);
+        if (startH == INT_MAX || goalH == INT_MAX) return {};
+        forward.nodes.emplace(start, Record{0, false, start, -1});
+        forward.push(start, 0, startH, startData);
+        backward.nodes.emplace(goal, Record{0, false, goal, -1});
+        backward.push(goal, 0, goalH, goalData);
+
+        int best = INT_MAX;
+        TopSpinStateSpace::TopSpinState meet;
+        while (!forward.open.empty() && !backward.open.empty()) {
+            int forwardPriority = forward.open.top().priority;
+            int backwardPriority = backward.open.top().priority;
+            int lowerBound = std::max({std::min(forwardPriority, backwardPriority), forward.fMin(), backward.fMin(),
+                                       forward.gMin() + backward.gMin() + 1});
+            if (best <= lowerBound) break;
+
+            bool isForward = forwardPriority <= backwardPriority;
+            Side& side = isForward ? forward : backward;
+            Side& other = isForward ? backward : forward;
+
+            Entry entry = side.pop();
+            Record& record = side.nodes.at(entry.state);
+            if (record.closed || record.g < entry.g) continue;
+            record.closed = true;
+            if (entry.f >= best) continue;
+            side.expanded++;
+
+            TopSpinStateSpace::TopSpinState parentView = view(entry.state, isForward);
+            for (const auto& action : stateSpace.actions) {
+                TopSpinStateSpace::TopSpinState child = entry.state;
+                action.apply(child);
+                stateSpace.canonicalize(child);
+                int g = entry.g + action.cost();
+
+                auto [it, inserted] = side.nodes.try_emplace(child, Record{g, false, entry.state, action.rotate});
+                if (!inserted) {
+                    if (it->second.g <= g) continue;
+                    it->second = Record{g, false, entry.state, action.rotate};
+                }
+
+                auto found = other.nodes.find(child);
+                if (found != other.nodes.end() && g + found->second.g < best) {
+                    best = g + found->second.g;
+                    meet = child;
+                }
+
+                // Relabelling and rotating leave the gap count unchanged, so the
+                // policy data follows from the parent's view.
+                int data = heuristic.childData(stateSpace, parentView, entry.data, action);
+                int childH = heuristic.value(stateSpace, view(child, isForward), data);
+                if (childH == INT_MAX) continue;
+                side.push(child, g, g + childH, data);
+            }
+        }
+
+        if (best == INT_MAX) return {};
+        return extract_path(start, goal, meet);
+    }
+
+    void runSearchAlgorithm(const std::string& heuristic) {
+        using namespace std::chrono;
+
+        auto timeStart = high_resolution_clock::now();
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> solution = solve(heuristic);
+        auto timeEnd = high_resolution_clock::now();
+
+        TopSpinStateSpace::TopSpinState initialState = stateSpace.getInitialState();
+        std::cout << "Initial State: " << initialState << "| h = " << stateSpace.h(initialState, heuristic) << std::endl;
+
+        double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+        std::cout << elapsedSeconds << " seconds search time" << std::endl;
+        std::cout << "Number of expanded nodes: " << getExpandedNodes() << " (forward " << forward.expanded
+                  << ", backward " << backward.expanded << ")" << std::endl;
+        topspin::printAbstractionCacheStats();
+
+        if (solution.empty() && !stateSpace.is_Goal(initialState)) {
+            std::cout << "No solution" << std::endl;
+        } else {
+            int totalCost = 0;
+            for (const auto& pair : solution) {
+                totalCost += pair.action.cost();
+            }
+            std::cout << "Solution length: " << solution.size() << std::endl;
+            std::cout << "Solution cost: " << totalCost << std::endl;
+            std::cout << "-----------------------------------------" << std::endl;
+        }
+    }
+};
+
+#endif
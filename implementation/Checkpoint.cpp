@@ -0,0 +1,116 @@
+#include "Checkpoint.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+namespace topspin {
+
+// Records are small, so both directions go through a large stream buffer.
+static constexpr size_t STREAM_BUFFER = size_t(1) << 20;
+
+bool CheckpointWriter::open(const std::string& target, CheckpointHeader header, const std::string& heuristic,
+                            const TopSpinState& initial) {
+    path = target;
+    // One search writes one checkpoint at a time, so a fixed name suffices
+    // and a write that was killed is simply overwritten by the next one.
+    temporary = path + ".tmp";
+    buffer.resize(STREAM_BUFFER);
+    out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    out.open(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    std::memcpy(header.magic, "TSCKPT\0\0", 8);
+    header.version = CHECKPOINT_VERSION;
+    header.heuristicLength = static_cast<uint16_t>(heuristic.size());
+    put(header);
+    write(heuristic.data(), heuristic.size());
+    for (int i = 0; i < initial.size; i++) put(initial.token(i));
+    return static_cast<bool>(out);
+}
+
+void CheckpointWriter::putState(const TopSpinState& state) {
+    if (state.isPacked()) put(state.packed);
+    else write(state.wide, state.size);
+}
+
+// The data reaches the disk before the rename, so a crash cannot leave a
+// renamed but incomplete checkpoint in place of the previous one.
+static bool syncFile(const std::string& file) {
+    int fd = ::open(file.c_str(), O_WRONLY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    return close(fd) == 0 && synced;
+}
+
+bool CheckpointWriter::commit() {
+    out.close();
+    if (!out || !syncFile(temporary) || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointReader::open(const std::string& path) {
+    buffer.resize(STREAM_BUFFER);
+    in.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    in.open(path, std::ios::binary);
+    if (!in || !get(head)) return false;
+    if (std::memcmp(head.magic, "TSCKPT\0\0", 8) != 0 || head.version != CHECKPOINT_VERSION) return false;
+
+    heuristicName.resize(head.heuristicLength);
+    initial.resize(head.n);
+    return read(heuristicName.data(), heuristicName.size()) && read(initial.data(), initial.size());
+}
+
+CheckpointReader::TopSpinState CheckpointReader::initialState() const {
+    return TopSpinState(initial, head.k);
+}
+
+bool CheckpointReader::getState(TopSpinState& state) {
+    if (state.isPacked()) return get(state.packed);
+    return read(state.wide, state.size);
+}
+
+bool BackgroundCheckpoint::start(const std::function<bool()>& write) {
+    if (busy()) return false;
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        if (!write()) std::cerr << "Could not write checkpoint\n";
+        return true;
+    }
+    if (pid == 0) {
+        // The search keeps the CPU where the two compete, and the exit
+        // handlers, which belong to the search, are skipped.
+        setpriority(PRIO_PROCESS, 0, 10);
+        bool written = write();
+        if (!written) std::cerr << "Could not write checkpoint\n";
+        _exit(written ? 0 : 1);
+    }
+    child = pid;
+    return true;
+}
+
+bool BackgroundCheckpoint::busy() {
+    if (child < 0) return false;
+    int status;
+    if (waitpid(child, &status, WNOHANG) == 0) return true;
+    child = -1;
+    return false;
+}
+
+void BackgroundCheckpoint::wait() {
+    if (child < 0) return;
+    int status;
+    waitpid(child, &status, 0);
+    child = -1;
+}
+
+} // namespace topspin
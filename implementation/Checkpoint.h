@@ -0,0 +1,130 @@
+#ifndef TOPSPIN_CHECKPOINT_H
+#define TOPSPIN_CHECKPOINT_H
+
+#include "TopSpinStateSpace.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace topspin {
+
+enum class CheckpointKind : uint8_t { AStar = 1, IDAStar = 2 };
+
+// Layout of a checkpoint file: this header, the heuristic name, the tokens of
+// the initial state and then the records of the search, all written in one
+// sequential pass. States are stored as their packed word (16 bytes) for
+// puzzles of up to TopSpinState::PACKED_MAX tokens and as n bytes otherwise.
+struct CheckpointHeader {
+    char magic[8];            // "TSCKPT\0\0"
+    uint32_t version;
+    uint8_t kind;             // CheckpointKind
+    uint8_t n;
+    uint8_t k;
+    uint8_t canonical;
+    uint8_t pruneLength;
+    uint8_t openList;         // A*: 0 heap, 1 bucket
+    uint16_t heuristicLength;
+    uint32_t reserved0;
+    uint64_t expanded;        // nodes expanded before the checkpoint
+    uint64_t nodes;           // A*: search nodes; IDA*: unfinished frontier tasks
+    uint64_t open;            // A*: ids of the open nodes
+    uint64_t closed;          // A*: closed states with their g
+    double bound;             // IDA*: bound of the interrupted iteration
+    double nextBound;         // IDA*: next bound found so far in that iteration
+    uint64_t closedContexts;  // A* with move pruning: expanded (state, context) pairs
+    uint8_t reserved[48];
+};
+static_assert(sizeof(CheckpointHeader) == 128, "checkpoint header must stay 128 bytes");
+
+static constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+// Streams a checkpoint to a temporary file next to path and renames it into
+// place on commit, so a crash during a write keeps the previous checkpoint.
+class CheckpointWriter {
+public:
+    using TopSpinState = TopSpinStateSpace::TopSpinState;
+
+    // Opens the temporary file and writes the header, the heuristic name and
+    // the initial state. header.magic, version and heuristicLength are filled
+    // in here.
+    bool open(const std::string& path, CheckpointHeader header, const std::string& heuristic,
+              const TopSpinState& initial);
+
+    void write(const void* data, size_t bytes) { out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes)); }
+    template <typename T>
+    void put(const T& value) { write(&value, sizeof(T)); }
+    void putState(const TopSpinState& state);
+
+    // Closes the file, syncs it to disk and renames it into place; on any
+    // error the temporary file is removed and false returned.
+    bool commit();
+
+private:
+    std::string path;
+    std::string temporary;
+    std::ofstream out;
+    std::vector<char> buffer;
+};
+
+// Reads a file written by CheckpointWriter in the same order.
+class CheckpointReader {
+public:
+    using TopSpinState = TopSpinStateSpace::TopSpinState;
+
+    // Opens path and reads everything up to the first record. Returns false
+    // if the file is missing, truncated or of another version.
+    bool open(const std::string& path);
+
+    const CheckpointHeader& header() const { return head; }
+    const std::string& heuristic() const { return heuristicName; }
+    // The initial state the checkpointed search was started from.
+    TopSpinState initialState() const;
+
+    bool read(void* data, size_t bytes) {
+        return static_cast<bool>(in.read(static_cast<char*>(data), static_cast<std::streamsize>(bytes)));
+    }
+    template <typename T>
+    bool get(T& value) { return read(&value, sizeof(T)); }
+    // Reads a state of the checkpointed puzzle into state, which must
+    // already have its size and k.
+    bool getState(TopSpinState& state);
+
+private:
+    std::ifstream in;
+    std::vector<char> buffer;
+    CheckpointHeader head{};
+    std::string heuristicName;
+    std::vector<uint8_t> initial;
+};
+
+// Writes checkpoints of a single-threaded search from a forked child, which
+// works on a copy-on-write snapshot of the process: the search only pauses
+// for the fork, however large the checkpoint. One write runs at a time. If
+// fork fails, the checkpoint is written in this process instead.
+class BackgroundCheckpoint {
+public:
+    BackgroundCheckpoint() = default;
+    BackgroundCheckpoint(const BackgroundCheckpoint&) = delete;
+    BackgroundCheckpoint& operator=(const BackgroundCheckpoint&) = delete;
+    ~BackgroundCheckpoint() { wait(); }
+
+    // Runs write unless the previous checkpoint is still being written, in
+    // which case nothing happens and false is returned.
+    bool start(const std::function<bool()>& write);
+    // Whether a child is still writing; reaps it once it is done.
+    bool busy();
+    // Blocks until the running write, if any, is done.
+    void wait();
+
+private:
+    pid_t child = -1;
+};
+
+} // namespace topspin
+
+#endif // TOPSPIN_CHECKPOINT_H
@@ -0,0 +1,302 @@
+#include "DistanceTable.h"
+#include "Profiling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace topspin {
+
+// Frontier words of 64 entries handed to a thread at a time.
+static constexpr uint64_t CHUNK_WORDS = 1024;
+static constexpr uint64_t NIBBLE_ONES = 0x1111111111111111ull;
+static constexpr uint64_t ALL_SLOTS = 0xEDCBA9876543210ull;
+
+static TopSpinStateSpace::TopSpinState identity(int n, int k) {
+    std::vector<uint8_t> permutation(n);
+    std::iota(permutation.begin(), permutation.end(), 1);
+    return TopSpinStateSpace::TopSpinState(permutation, k);
+}
+
+// Entry of a state at distance d.
+static uint8_t residue(int d) { return static_cast<uint8_t>(d % 3 + 1); }
+
+uint64_t DistanceTable::stateCount(int n) {
+    if (n < 1 || n > MAX_TOKENS) return UINT64_MAX;
+    uint64_t count = 1;
+    for (int j = 2; j < n; j++) count *= j;
+    return count;
+}
+
+DistanceTable::DistanceTable(int n, int k)
+    : n(n), k(k), space(n, identity(n, k)), entries(stateCount(n)) {}
+
+DistanceTable::~DistanceTable() {
+    if (mapped) munmap(mapped, mappedSize);
+}
+
+// Both directions keep up to 15 token slots 4 bits each in one word, so
+// neither needs a popcount or a scan over the slots.
+uint64_t DistanceTable::rank(const TopSpinState& state) const {
+    TopSpinState::Packed tokens = state.packed >> TopSpinState::TOKEN_BITS;
+    uint64_t index = 0;
+    uint64_t smaller = 0;   // nibble s: number of slots below s already used
+    for (int j = 1; j < n; j++) {
+        int slot = static_cast<int>(tokens & 0x1F) - 2;
+        tokens >>= TopSpinState::TOKEN_BITS;
+        index = index * (n - j) + (slot - static_cast<int>((smaller >> (4 * slot)) & 0xF));
+        smaller += (NIBBLE_ONES << (4 * slot)) << 4;
+    }
+    return index;
+}
+
+void DistanceTable::unrank(uint64_t index, TopSpinState& state) const {
+    uint8_t digits[MAX_TOKENS];
+    for (int j = n - 1; j >= 1; j--) {
+        // Most tables have fewer than 2^32 entries, and 32-bit division is
+        // several times faster.
+        uint32_t radix = static_cast<uint32_t>(n - j);
+        if (index >> 32) {
+            digits[j] = static_cast<uint8_t>(index % radix);
+            index /= radix;
+        } else {
+            digits[j] = static_cast<uint8_t>(static_cast<uint32_t>(index) % radix);
+            index = static_cast<uint32_t>(index) / radix;
+        }
+    }
+    using Packed = TopSpinState::Packed;
+    Packed packed = 1;
+    uint64_t unused = ALL_SLOTS;   // nibble i: the i-th smallest unused slot
+    for (int j = 1; j < n; j++) {
+        int shift = 4 * digits[j];
+        uint64_t slot = (unused >> shift) & 0xF;
+        unused = (unused & ((uint64_t(1) << shift) - 1)) | ((unused >> (shift + 4)) << shift);
+        packed |= static_cast<Packed>(slot + 2) << (TopSpinState::TOKEN_BITS * j);
+    }
+    state.packed = packed;
+}
+
+std::unique_ptr<DistanceTable> DistanceTable::build(int n, int k, int threads, const Visitor& visit) {
+    TOPSPIN_PROFILE_SCOPE("distanceTable.build");
+    if (n < 2 || n > MAX_TOKENS || k < 2 || k > n) return nullptr;
+    auto result = std::make_unique<DistanceTable>(n, k);
+    DistanceTable& table = *result;
+    // Children land anywhere in both arrays, so they are backed by huge
+    // pages where the system allows, to keep TLB misses down.
+    auto allocate = [](uint64_t words) {
+        constexpr size_t HUGE_PAGE = size_t(2) << 20;
+        size_t bytes = (words * sizeof(uint64_t) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        std::unique_ptr<uint64_t[], Free> memory(static_cast<uint64_t*>(std::aligned_alloc(HUGE_PAGE, bytes)));
+        if (memory) {
+            madvise(memory.get(), bytes, MADV_HUGEPAGE);
+            std::memset(memory.get(), 0, bytes);
+        }
+        return memory;
+    };
+    table.storage = allocate((table.entries + 31) / 32);
+    std::unique_ptr<uint64_t[], Free> frontier = allocate((table.entries + 63) / 64);
+    if (!table.storage || !frontier) return nullptr;
+    table.table = reinterpret_cast<const uint8_t*>(table.storage.get());
+
+    // Every rotation of the identity is the goal; its canonical form ranks 0.
+    table.storage[0] = residue(0);
+    frontier[0] = 1;
+    table.layerSizes.push_back(1);
+    threads = std::max(threads, 1);
+    std::vector<uint64_t> added(threads);
+    for (int depth = 0; table.layerSizes[depth] > 0; depth++) {
+        table.expandLayer(depth, threads, frontier.get(), visit, added);
+        uint64_t next = std::accumulate(added.begin(), added.end(), uint64_t(0));
+        if (next == 0) break;
+        table.layerSizes.push_back(next);
+    }
+    table.diameter = static_cast<int>(table.layerSizes.size()) - 1;
+    table.reached = std::accumulate(table.layerSizes.begin(), table.layerSizes.end(), uint64_t(0));
+    return result;
+}
+
+// Expands every state at distance depth and marks its unseen neighbours as
+// the next layer. Layers three apart share a residue, so the states to
+// expand are taken from the frontier bitmap, which holds one bit per entry
+// for the states of this layer and of the next one; the two differ in
+// residue. Threads take chunks of the bitmap in order and clear the bits of
+// the states they expanded. A neighbour is claimed by or-ing its residue
+// into a zero entry, which every thread writes identically, and only the
+// thread that saw the entry still zero counts it and adds it to the frontier.
+void DistanceTable::expandLayer(int depth, int threads, uint64_t* frontier, const Visitor& visit,
+                                std::vector<uint64_t>& added) {
+    const uint64_t words = (entries + 63) / 64;
+    const uint8_t current = residue(depth);
+    const uint64_t next = residue(depth + 1);
+    std::atomic<uint64_t> nextChunk{0};
+
+    auto work = [&](int thread) {
+        TopSpinState state = identity(n, k);
+        uint64_t count = 0;
+        for (uint64_t chunk; (chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) * CHUNK_WORDS < words; ) {
+            uint64_t end = std::min(words, (chunk + 1) * CHUNK_WORDS);
+            for (uint64_t w = chunk * CHUNK_WORDS; w < end; w++) {
+                std::atomic_ref<uint64_t> frontierWord(frontier[w]);
+                uint64_t candidates = frontierWord.load(std::memory_order_relaxed);
+                uint64_t expanded = 0;
+                while (candidates) {
+                    int bit = __builtin_ctzll(candidates);
+                    candidates &= candidates - 1;
+                    uint64_t index = w * 64 + bit;
+                    uint64_t entryWord = std::atomic_ref<uint64_t>(storage[index >> 5]).load(std::memory_order_relaxed);
+                    if (((entryWord >> ((index & 31) * 2)) & 3) != current) continue;
+                    expanded |= uint64_t(1) << bit;
+                    unrank(index, state);
+                    if (visit) visit(thread, state, depth);
+                    // Every state here is packed, so restoring the word is
+                    // cheaper than undoing the reversal. The children's
+                    // entries are scattered over the table; all of them are
+                    // prefetched before the first is claimed.
+                    const TopSpinState::Packed parent = state.packed;
+                    uint64_t children[MAX_TOKENS];
+                    for (int r = 0; r < n; r++) {
+                        space.applyInPlace(state, TopSpinStateSpace::TopSpinAction(r), true);
+                        children[r] = rank(state);
+                        state.packed = parent;
+                        __builtin_prefetch(&storage[children[r] >> 5], 1);
+                    }
+                    for (int r = 0; r < n; r++) {
+                        uint64_t child = children[r];
+                        int shift = static_cast<int>(child & 31) * 2;
+                        std::atomic_ref<uint64_t> target(storage[child >> 5]);
+                        if ((target.load(std::memory_order_relaxed) >> shift) & 3) continue;
+                        uint64_t before = target.fetch_or(next << shift, std::memory_order_relaxed);
+                        if (((before >> shift) & 3) != 0) continue;
+                        count++;
+                        std::atomic_ref<uint64_t>(frontier[child >> 6]).fetch_or(uint64_t(1) << (child & 63),
+                                                                                  std::memory_order_relaxed);
+                    }
+                }
+                if (expanded) frontierWord.fetch_and(~expanded, std::memory_order_relaxed);
+            }
+        }
+        added[thread] = count;
+    };
+
+    if (threads == 1) {
+        work(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) workers.emplace_back(work, t);
+    for (auto& worker : workers) worker.join();
+}
+
+int DistanceTable::distance(const TopSpinState& input) const {
+    if (input.size != n || input.k != k) return -1;
+    TopSpinState state = input;
+    space.canonicalize(state);
+    uint64_t index = rank(state);
+    uint8_t code = entry(index);
+    if (code == 0) return -1;
+
+    int d = 0;
+    while (index != 0) {
+        // Some neighbour is one step closer to the goal, and no neighbour
+        // two steps farther away can share its residue.
+        uint8_t closer = code == 1 ? 3 : code - 1;
+        bool moved = false;
+        for (int r = 0; r < n && !moved; r++) {
+            TopSpinStateSpace::AppliedAction applied = space.applyInPlace(state, TopSpinStateSpace::TopSpinAction(r), true);
+            uint64_t child = rank(state);
+            if (entry(child) == closer) {
+                index = child;
+                moved = true;
+            } else {
+                space.undo(state, applied);
+            }
+        }
+        if (!moved) return -1;   // not a table of this puzzle
+        code = closer;
+        d++;
+    }
+    return d;
+}
+
+bool DistanceTable::map(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    size_t expected = sizeof(DistanceTableHeader) + tableBytes();
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != expected) {
+        close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) return false;
+
+    const auto* header = static_cast<const DistanceTableHeader*>(address);
+    bool valid = std::memcmp(header->magic, "TSBFS\0\0\0", 8) == 0 &&
+                 header->version == FILE_VERSION &&
+                 header->n == n && header->k == k &&
+                 header->ranking == static_cast<uint8_t>(StateRanking::LehmerModuloRotation) &&
+                 header->entryBits == 2 &&
+                 header->entries == entries;
+    if (!valid) {
+        munmap(address, expected);
+        return false;
+    }
+    madvise(address, expected, MADV_RANDOM);
+
+    mapped = address;
+    mappedSize = expected;
+    reached = header->reached;
+    diameter = static_cast<int>(header->maxDistance);
+    table = static_cast<const uint8_t*>(address) + sizeof(DistanceTableHeader);
+    return true;
+}
+
+std::unique_ptr<DistanceTable> DistanceTable::load(const std::string& path, int n, int k) {
+    if (n < 2 || n > MAX_TOKENS || k < 2 || k > n) return nullptr;
+    auto result = std::make_unique<DistanceTable>(n, k);
+    if (!result->map(path)) return nullptr;
+    return result;
+}
+
+bool DistanceTable::save(const std::string& path) const {
+    DistanceTableHeader header{};
+    std::memcpy(header.magic, "TSBFS\0\0\0", 8);
+    header.version = FILE_VERSION;
+    header.n = static_cast<uint8_t>(n);
+    header.k = static_cast<uint8_t>(k);
+    header.ranking = static_cast<uint8_t>(StateRanking::LehmerModuloRotation);
+    header.entryBits = 2;
+    header.maxDistance = static_cast<uint32_t>(diameter);
+    header.entries = entries;
+    header.reached = reached;
+
+    std::string temporary = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table), static_cast<std::streamsize>(tableBytes()));
+        // Closing flushes the last buffer, which can fail as well.
+        out.close();
+        if (!out) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace topspin
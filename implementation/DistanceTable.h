@@ -0,0 +1,123 @@
+#ifndef TOPSPIN_DISTANCE_TABLE_H
+#define TOPSPIN_DISTANCE_TABLE_H
+
+#include "TopSpinStateSpace.h"
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+
+namespace topspin {
+
+// How states are mapped to table indices.
+enum class StateRanking : uint8_t {
+    LehmerModuloRotation = 1   // token 1 rotated to position 0, Lehmer code of tokens 2..n
+};
+
+// Layout of a distance table file: this header followed by the table with
+// four 2-bit entries per byte, lowest bits first.
+struct DistanceTableHeader {
+    char magic[8];            // "TSBFS\0\0\0"
+    uint32_t version;
+    uint8_t n;
+    uint8_t k;
+    uint8_t ranking;          // StateRanking
+    uint8_t entryBits;
+    uint32_t maxDistance;
+    uint32_t reserved0;
+    uint64_t entries;
+    uint64_t reached;
+    uint8_t reserved[88];
+};
+static_assert(sizeof(DistanceTableHeader) == 128, "distance table header must stay 128 bytes");
+
+// Exact distance to the goal of every state of TopSpin(n, k) up to rotation,
+// found by a breadth-first enumeration of the whole state space. States are
+// ranked densely, so the table has (n-1)! entries and no keys.
+//
+// Every entry is 2 bits: 0 for a state that was never reached and otherwise
+// 1 + distance mod 3. During the search the entries are the visited set, and
+// a bitmap of one bit per entry marks the frontier, so no queue is kept.
+// The distances of neighbours differ by at most one, which makes the residue
+// enough to get the exact distance back: some neighbour of a state at
+// distance d > 0 has residue d - 1, and following such neighbours reaches the
+// goal in d steps.
+class DistanceTable {
+public:
+    using TopSpinState = TopSpinStateSpace::TopSpinState;
+
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr int MAX_TOKENS = 16;
+
+    // Called for every reachable state as its layer is expanded, with its
+    // distance and the index of the calling thread (below the thread count).
+    using Visitor = std::function<void(int thread, const TopSpinState& state, int distance)>;
+
+    // Enumerates the state space with the given number of threads, each
+    // layer split between them by index range. Returns nullptr if the table
+    // cannot be allocated.
+    static std::unique_ptr<DistanceTable> build(int n, int k, int threads, const Visitor& visit = nullptr);
+
+    // Maps a file written by save() read-only. Returns nullptr if the file is
+    // missing or was written for a different puzzle or version.
+    static std::unique_ptr<DistanceTable> load(const std::string& path, int n, int k);
+
+    // Writes the table to a temporary file and renames it into place.
+    bool save(const std::string& path) const;
+
+    // Number of states up to rotation, (n-1)!, or UINT64_MAX above MAX_TOKENS.
+    static uint64_t stateCount(int n);
+
+    DistanceTable(int n, int k);
+    DistanceTable(const DistanceTable&) = delete;
+    DistanceTable& operator=(const DistanceTable&) = delete;
+    ~DistanceTable();
+
+    // Index of a canonical state (token 1 at position 0) and back.
+    uint64_t rank(const TopSpinState& state) const;
+    void unrank(uint64_t rank, TopSpinState& state) const;
+
+    // Exact distance of any state of this puzzle, -1 if the goal cannot be
+    // reached from it.
+    int distance(const TopSpinState& state) const;
+
+    uint64_t size() const { return entries; }
+    uint64_t reachedStates() const { return reached; }
+    int maxDistance() const { return diameter; }
+    // Number of states at each distance; only known for a table built in
+    // this process.
+    const std::vector<uint64_t>& layers() const { return layerSizes; }
+    bool isMapped() const { return mapped != nullptr; }
+
+private:
+    struct Free {
+        void operator()(uint64_t* p) const { std::free(p); }
+    };
+
+    int n;
+    int k;
+    TopSpinStateSpace space;
+    uint64_t entries;
+    uint64_t reached = 0;
+    int diameter = -1;
+    std::vector<uint64_t> layerSizes;
+
+    std::unique_ptr<uint64_t[], Free> storage;   // packed table when built in this process
+    const uint8_t* table = nullptr;              // storage or the table inside the mapped file
+    void* mapped = nullptr;
+    size_t mappedSize = 0;
+
+    uint8_t entry(uint64_t index) const { return (table[index >> 2] >> ((index & 3) * 2)) & 3; }
+    size_t tableBytes() const { return static_cast<size_t>((entries + 3) / 4); }
+
+    void expandLayer(int depth, int threads, uint64_t* frontier, const Visitor& visit,
+                     std::vector<uint64_t>& added);
+    bool map(const std::string& path);
+};
+
+} // namespace topspin
+
+#endif // TOPSPIN_DISTANCE_TABLE_H
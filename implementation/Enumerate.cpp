@@ -0,0 +1,228 @@
+#include "DistanceTable.h"
+#include "AStarSearch.h"
+#include "IDAStarSearch.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <climits>
+#include <cstdint>
+
+using namespace std;
+using topspin::DistanceTable;
+using TopSpinState = TopSpinStateSpace::TopSpinState;
+
+// Admissibility check of one heuristic against the exact distances.
+struct Check {
+    uint64_t states = 0;
+    uint64_t exact = 0;
+    uint64_t overestimates = 0;
+    int maxExcess = 0;
+    uint64_t sumH = 0;
+    uint64_t sumDistance = 0;
+
+    void add(int h, int distance) {
+        states++;
+        sumH += h;
+        sumDistance += distance;
+        if (h == distance) exact++;
+        if (h > distance) {
+            overestimates++;
+            maxExcess = max(maxExcess, h - distance);
+        }
+    }
+
+    void merge(const Check& other) {
+        states += other.states;
+        exact += other.exact;
+        overestimates += other.overestimates;
+        maxExcess = max(maxExcess, other.maxExcess);
+        sumH += other.sumH;
+        sumDistance += other.sumDistance;
+    }
+};
+
+// An optimal search whose solution lengths are compared with the table.
+struct Solver {
+    string name;
+    function<size_t(const TopSpinState&)> solve;
+};
+
+// Every puzzle verify is meant for fits a 1 MiB IDA* table, which is much
+// cheaper to set up thousands of times than the default.
+static constexpr size_t VERIFY_TABLE_BYTES = size_t(1) << 20;
+
+static vector<Solver> solvers(const string& heuristic) {
+    vector<Solver> result;
+    for (string openList : {"heap", "bucket"}) {
+        result.push_back({"A* " + openList + " canonical", [=](const TopSpinState& state) {
+            return AStarSearch(state, true).solve(heuristic, openList).size();
+        }});
+        for (int prune = 0; prune <= topspin::MovePruning::MAX_LENGTH; prune++) {
+            if (prune == 1) continue;
+            result.push_back({"A* " + openList + " prune=" + to_string(prune), [=](const TopSpinState& state) {
+                return AStarSearch(state, false, prune).solve(heuristic, openList).size();
+            }});
+        }
+    }
+    for (int threads : {1, 4}) {
+        string name = "IDA* threads=" + to_string(threads);
+        result.push_back({name + " canonical", [=](const TopSpinState& state) {
+            IDAStarSearch search(state, true);
+            search.setThreads(threads);
+            search.tableBytes = VERIFY_TABLE_BYTES;
+            return search.run_Algorithm(heuristic).size();
+        }});
+        for (int prune = 0; prune <= topspin::MovePruning::MAX_LENGTH; prune++) {
+            if (prune == 1) continue;
+            result.push_back({name + " prune=" + to_string(prune), [=](const TopSpinState& state) {
+                IDAStarSearch search(state, false, prune);
+                search.setThreads(threads);
+                search.tableBytes = VERIFY_TABLE_BYTES;
+                return search.run_Algorithm(heuristic).size();
+            }});
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " n k [threads=T] [out=path] [check=h1;h2;...] [verify=h]\n";
+        return 1;
+    }
+
+    int n = std::atoi(argv[1]);
+    int k = std::atoi(argv[2]);
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    string outPath;
+    string verifyHeuristic;
+    vector<string> heuristics;
+    for (int i = 3; i < argc; i++) {
+        string option = argv[i];
+        if (option.rfind("threads=", 0) == 0) threads = std::atoi(option.c_str() + 8);
+        else if (option.rfind("out=", 0) == 0) outPath = option.substr(4);
+        else if (option.rfind("verify=", 0) == 0) verifyHeuristic = option.substr(7);
+        else if (option.rfind("check=", 0) == 0) {
+            stringstream names(option.substr(6));
+            for (string name; getline(names, name, ';');) heuristics.push_back(name);
+        }
+    }
+    threads = max(1, threads);
+    if (n < 2 || n > DistanceTable::MAX_TOKENS || k < 2 || k > n) {
+        std::cerr << "Need 2 <= k <= n <= " << DistanceTable::MAX_TOKENS << "\n";
+        return 1;
+    }
+
+    // Every heuristic is evaluated through the policy the searches use.
+    vector<uint8_t> goal(n);
+    for (int t = 0; t < n; t++) goal[t] = static_cast<uint8_t>(t + 1);
+    TopSpinStateSpace space(n, TopSpinState(goal, k));
+    vector<function<int(const TopSpinState&)>> evaluators;
+    for (const string& name : heuristics) {
+        evaluators.push_back(TopSpinStateSpace::withHeuristic(name, [&](const auto& policy) {
+            return function<int(const TopSpinState&)>([policy, &space](const TopSpinState& state) {
+                return policy.value(space, state, policy.data(space, state));
+            });
+        }));
+        if (evaluators.back()(space.getInitialState()) == INT_MAX) {
+            std::cerr << "Unknown heuristic " << name << "\n";
+            return 1;
+        }
+    }
+
+    vector<vector<Check>> checks(threads, vector<Check>(evaluators.size()));
+    // verify also records the visits the build makes: one per reached state,
+    // with the distance the finished table gives it. The ranking needs no
+    // table of its own.
+    bool verifying = !verifyHeuristic.empty();
+    DistanceTable ranking(n, k);
+    vector<uint64_t> visits(threads);
+    vector<int8_t> visitedAt;
+    if (verifying) visitedAt.assign(DistanceTable::stateCount(n), -1);
+    DistanceTable::Visitor visit;
+    if (!evaluators.empty() || verifying) {
+        visit = [&](int thread, const TopSpinState& state, int distance) {
+            for (size_t i = 0; i < evaluators.size(); i++) checks[thread][i].add(evaluators[i](state), distance);
+            if (verifying) {
+                visits[thread]++;
+                visitedAt[ranking.rank(state)] = static_cast<int8_t>(distance);
+            }
+        };
+    }
+
+    uint64_t states = DistanceTable::stateCount(n);
+    std::cout << "TopSpin(" << n << ", " << k << "): " << states << " states up to rotation, "
+              << (states + 3) / 4 / (1024 * 1024) << " MiB table, " << (states + 7) / 8 / (1024 * 1024)
+              << " MiB frontier, " << threads << " threads" << std::endl;
+
+    auto timeStart = chrono::high_resolution_clock::now();
+    unique_ptr<DistanceTable> table = DistanceTable::build(n, k, threads, visit);
+    auto timeEnd = chrono::high_resolution_clock::now();
+    if (!table) {
+        std::cerr << "Could not allocate the distance table\n";
+        return 1;
+    }
+
+    for (size_t d = 0; d < table->layers().size(); d++)
+        std::cout << "Distance " << d << ": " << table->layers()[d] << " states" << std::endl;
+    std::cout << chrono::duration<double>(timeEnd - timeStart).count() << " seconds enumeration time" << std::endl;
+    std::cout << "Reached states: " << table->reachedStates() << " of " << table->size() << std::endl;
+    std::cout << "Diameter: " << table->maxDistance() << std::endl;
+
+    for (size_t i = 0; i < heuristics.size(); i++) {
+        Check total;
+        for (int t = 0; t < threads; t++) total.merge(checks[t][i]);
+        std::cout << heuristics[i] << ": ";
+        if (total.overestimates == 0) std::cout << "admissible";
+        else std::cout << total.overestimates << " overestimates (by up to " << total.maxExcess << ")";
+        std::cout << ", mean h " << static_cast<double>(total.sumH) / total.states
+                  << " of mean distance " << static_cast<double>(total.sumDistance) / total.states
+                  << ", exact on " << 100.0 * total.exact / total.states << "% of states" << std::endl;
+    }
+
+    // Every reachable state is solved from scratch by each search, which
+    // must find a path of exactly the distance in the table.
+    bool passed = true;
+    if (verifying) {
+        TopSpinState state = space.getInitialState();
+        uint64_t calls = accumulate(visits.begin(), visits.end(), uint64_t(0));
+        uint64_t wrongDistances = 0;
+        for (uint64_t rank = 0; rank < table->size(); rank++) {
+            table->unrank(rank, state);
+            if (visitedAt[rank] != table->distance(state)) wrongDistances++;
+        }
+        std::cout << "Visitor: " << calls << " calls for " << table->reachedStates() << " states, "
+                  << wrongDistances << " states with a wrong or missing distance" << std::endl;
+        passed = calls == table->reachedStates() && wrongDistances == 0;
+
+        for (const Solver& solver : solvers(verifyHeuristic)) {
+            uint64_t wrong = 0;
+            uint64_t firstWrong = 0;
+            for (uint64_t rank = 0; rank < table->size(); rank++) {
+                table->unrank(rank, state);
+                int distance = table->distance(state);
+                if (distance < 0 || solver.solve(state) == static_cast<size_t>(distance)) continue;
+                if (wrong++ == 0) firstWrong = rank;
+            }
+            std::cout << solver.name << ": ";
+            if (wrong == 0) std::cout << "optimal on all " << table->reachedStates() << " states" << std::endl;
+            else std::cout << wrong << " wrong solution lengths, first at rank " << firstWrong << std::endl;
+            passed = passed && wrong == 0;
+        }
+    }
+
+    if (!outPath.empty()) {
+        if (!table->save(outPath)) {
+            std::cerr << "Could not write " << outPath << "\n";
+            return 1;
+        }
+        std::cout << "Wrote " << outPath << std::endl;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#include "ExternalSearch.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <random>
+#include <cstdint>
+
+using namespace std;
+
+TopSpinStateSpace::TopSpinState createRandomState(int size, int k, int m) {
+    std::vector<uint8_t> permutation(size);
+    std::iota(permutation.begin(), permutation.end(), 1);
+    TopSpinStateSpace::TopSpinState state(permutation, k);
+
+    std::random_device rd;
+    std::mt19937 rng(rd());
+    std::uniform_int_distribution<int> dist(0, size - 1);
+
+    for (int i = 0; i < m; i++) {
+        int pos = dist(rng);
+        TopSpinStateSpace::TopSpinAction action(pos);
+        action.apply(state);
+    }
+    return state;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " n k m h [dir=path] [memory=MB]\n";
+        return 1;
+    }
+
+    int n = std::atoi(argv[1]);
+    int k = std::atoi(argv[2]);
+    int m = std::atoi(argv[3]);
+    string heuristic = argv[4];
+    TopSpinStateSpace::TopSpinState initialState = createRandomState(n, k, m);
+    ExternalSearch search(initialState);
+    for (int i = 5; i < argc; i++) {
+        string option = argv[i];
+        if (option.rfind("dir=", 0) == 0) search.directory = option.substr(4);
+        else if (option.rfind("memory=", 0) == 0) search.memoryBytes = static_cast<size_t>(std::atoll(option.c_str() + 7)) << 20;
+    }
+    search.runSearchAlgorithm(heuristic);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#ifndef EXTERNALSEARCH_H
+#define EXTERNALSEARCH_H
+
+#include "TopSpinStateSpace.h"
+#include "AbstractionCache.h"
+#include "ExternalStorage.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <climits>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+// Breadth-first iterative-deepening A* with delayed duplicate detection on
+// disk. Each iteration searches breadth-first on rotation-canonical states and
+// prunes every node with f above the bound; the next bound is the smallest f
+// that was pruned. The layers live in sorted files in a scratch directory:
+// successors of layer g are collected in a memory buffer that is sorted and
+// spilled as runs, and the runs are merged into layer g + 1 while dropping
+// every state already in layer g or g - 1. The moves are self-inverse, so no
+// successor of layer g can lie in an earlier layer, and memory use is bounded
+// by the sort buffer no matter how many states are stored.
+//
+// The solution is rebuilt backwards from the goal by looking up a neighbour of
+// each state in the layer before it.
+class ExternalSearch {
+private:
+    // A record is a canonical state without its leading token 1, followed by
+    // four bytes of heuristic policy data.
+    topspin::RecordFormat format() const {
+        size_t keyBytes = static_cast<size_t>(stateSpace.n - 1);
+        return {keyBytes + sizeof(int32_t), keyBytes};
+    }
+
+    void encode(const TopSpinStateSpace::TopSpinState& state, int data, uint8_t* record) const {
+        for (int i = 1; i < state.size; i++) record[i - 1] = state.token(i);
+        int32_t value = data;
+        std::memcpy(record + state.size - 1, &value, sizeof(value));
+    }
+
+    TopSpinStateSpace::TopSpinState decode(const uint8_t* record, int k, int& data) const {
+        thread_local std::vector<uint8_t> permutation;
+        permutation.assign(stateSpace.n, 1);
+        for (int i = 1; i < stateSpace.n; i++) permutation[i] = record[i - 1];
+        int32_t value;
+        std::memcpy(&value, record + stateSpace.n - 1, sizeof(value));
+        data = value;
+        return TopSpinStateSpace::TopSpinState(permutation, k);
+    }
+
+    // The action that leads from state to the canonical state target.
+    int actionTo(const TopSpinStateSpace::TopSpinState& state, const TopSpinStateSpace::TopSpinState& target) const {
+        for (const auto& action : stateSpace.actions) {
+            TopSpinStateSpace::TopSpinState next = state;
+            action.apply(next);
+            stateSpace.canonicalize(next);
+            if (next == target) return action.rotate;
+        }
+        return -1;
+    }
+
+    // chain holds the goal and its parent in layer chain.size() - 2; every
+    // earlier state is a neighbour found in the layer file before it.
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> extract_path(std::vector<TopSpinStateSpace::TopSpinState> chain,
+                                                                        const std::vector<std::string>& layers) const {
+        topspin::RecordFormat layout = format();
+        std::vector<uint8_t> record(layout.width);
+        for (int layer = static_cast<int>(layers.size()) - 2; layer >= 0; layer--) {
+            const TopSpinStateSpace::TopSpinState& state = chain.back();
+            bool found = false;
+            for (const auto& action : stateSpace.actions) {
+                TopSpinStateSpace::TopSpinState neighbour = state;
+                action.apply(neighbour);
+                stateSpace.canonicalize(neighbour);
+                encode(neighbour, 0, record.data());
+                if (topspin::findRecord(layers[layer], layout, record.data())) {
+                    chain.push_back(neighbour);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) return {};
+        }
+        std::reverse(chain.begin(), chain.end());
+
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> path;
+        for (size_t i = 1; i < chain.size(); i++) {
+            TopSpinStateSpace::TopSpinAction action(actionTo(chain[i - 1], chain[i]));
+            path.emplace_back(action, chain[i]);
+        }
+        return stateSpace.restoreRotation(path);
+    }
+
+public:
+    TopSpinStateSpace stateSpace;
+
+    // Directory in which the scratch directory is created; it should be on a
+    // local disk, not a memory-backed file system. Defaults to
+    // $TOPSPIN_EXTERNAL_DIR, or the working directory.
+    std::string directory;
+    // Size of the buffer in which successors are sorted before they are
+    // written as a run.
+    size_t memoryBytes = size_t(512) << 20;
+
+    long long nodesExpanded = 0;
+    int iterations = 0;
+    // Records in the layers of the last iteration and bytes written overall.
+    uint64_t storedRecords = 0;
+    uint64_t bytesWritten = 0;
+    bool storageFailed = false;
+
+    ExternalSearch(const TopSpinStateSpace::TopSpinState& initialState)
+        : stateSpace(initialState.size, initialState) {
+        const char* configured = std::getenv("TOPSPIN_EXTERNAL_DIR");
+        directory = configured ? configured : ".";
+    }
+
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> solve(const std::string& heuristic) {
+        return TopSpinStateSpace::withHeuristic(heuristic, [&](const auto& policy) {
+            return run_Algorithm(policy);
+        });
+    }
+
+    template <typename Heuristic>
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> run_Algorithm(const Heuristic& heuristic) {
+        nodesExpanded = 0;
+        iterations = 0;
+        storedRecords = 0;
+        bytesWritten = 0;
+        storageFailed = false;
+
+        TopSpinStateSpace::TopSpinState start = stateSpace.getInitialState();
+        stateSpace.canonicalize(start);
+        std::vector<uint8_t> identity(stateSpace.n);
+        for (int i = 0; i < stateSpace.n; i++) identity[i] = static_cast<uint8_t>(i + 1);
+        TopSpinStateSpace::TopSpinState goal(identity, start.k);
+        if (start == goal) return {};
+
+        int startData = heuristic.data(stateSpace, start);
+        int startH = heuristic.value(stateSpace, start, startData);
+        if (startH == INT_MAX) return {};
+
+        topspin::ScratchDirectory scratch(directory);
+        if (!scratch.valid()) {
+            storageFailed = true;
+            return {};
+        }
+        topspin::RecordFormat layout = format();
+        std::vector<uint8_t> record(layout.width);
+
+        int bound = startH;
+        while (true) {
+            iterations++;
+            std::vector<std::string> layers{scratch.newFile("layer")};
+            {
+                topspin::SortedRunWriter writer(scratch, layout, layout.width);
+                encode(start, startData, record.data());
+                writer.add(record.data());
+                std::vector<std::string> runs = writer.finish();
+                topspin::MergeStats stats = topspin::mergeRuns(scratch, runs, {}, layers[0], layout);
+                storageFailed |= writer.failed() || stats.failed;
+            }
+            storedRecords = 1;
+
+            int nextBound = INT_MAX;
+            std::vector<TopSpinStateSpace::TopSpinState> chain;
+            for (int g = 0; chain.empty() && !storageFailed; g++) {
+                topspin::SortedRunWriter writer(scratch, layout, memoryBytes);
+                topspin::RecordReader reader(layers[g], layout);
+                for (; reader.valid() && chain.empty(); reader.next()) {
+                    int data;
+                    TopSpinStateSpace::TopSpinState state = decode(reader.current(), start.k, data);
+                    nodesExpanded++;
+                    for (const auto& action : stateSpace.actions) {
+                        TopSpinStateSpace::TopSpinState child = state;
+                        action.apply(child);
+                        stateSpace.canonicalize(child);
+                        int childG = g + action.cost();
+                        if (child == goal) {
+                            if (childG <= bound) {
+                                chain = {child, state};
+                                break;
+                            }
+                            nextBound = std::min(nextBound, childG);
+                            continue;
+                        }
+                        int childData = heuristic.childData(stateSpace, state, data, action);
+                        int childH = heuristic.value(stateSpace, child, childData);
+                        if (childH == INT_MAX) continue;
+                        if (childG + childH > bound) {
+                            nextBound = std::min(nextBound, childG + childH);
+                            continue;
+                        }
+                        encode(child, childData, record.data());
+                        writer.add(record.data());
+                    }
+                }
+                std::vector<std::string> runs = writer.finish();
+                storageFailed |= reader.failed() || writer.failed();
+                bytesWritten += writer.bytesWritten();
+                if (!chain.empty()) break;
+
+                // Duplicates of the new layer can only be in this layer or
+                // the one before it.
+                std::vector<std::string> previous{layers[g]};
+                if (g > 0) previous.push_back(layers[g - 1]);
+                layers.push_back(scratch.newFile("layer"));
+                topspin::MergeStats stats = topspin::mergeRuns(scratch, runs, previous, layers.back(), layout);
+                storageFailed |= stats.failed;
+                bytesWritten += stats.bytesWritten;
+                storedRecords += stats.records;
+                if (stats.records == 0) break;
+            }
+
+            if (storageFailed) return {};
+            if (!chain.empty()) return extract_path(chain, layers);
+            for (const std::string& layer : layers) std::remove(layer.c_str());
+            if (nextBound == INT_MAX) return {};
+            bound = nextBound;
+        }
+    }
+
+    void runSearchAlgorithm(const std::string& heuristic) {
+        using namespace std::chrono;
+
+        auto timeStart = high_resolution_clock::now();
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> solution = solve(heuristic);
+        auto timeEnd = high_resolution_clock::now();
+
+        TopSpinStateSpace::TopSpinState initialState = stateSpace.getInitialState();
+        std::cout << "Initial State: " << initialState << "| h = " << stateSpace.h(initialState, heuristic) << std::endl;
+
+        double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+        std::cout << elapsedSeconds << " seconds search time" << std::endl;
+        std::cout << "Number of expanded nodes: " << nodesExpanded << " (" << iterations << " iterations)" << std::endl;
+        std::cout << "Stored records: " << storedRecords << ", " << bytesWritten / (1024 * 1024)
+                  << " MiB written" << std::endl;
+        topspin::printAbstractionCacheStats();
+
+        if (storageFailed) {
+            std::cout << "External storage error" << std::endl;
+        } else if (solution.empty() && !stateSpace.is_Goal(initialState)) {
+            std::cout << "No solution" << std::endl;
+        } else {
+            int totalCost = 0;
+            for (const auto& pair : solution) {
+                totalCost += pair.action.cost();
+            }
+            std::cout << "Solution length: " << solution.size() << std::endl;
+            std::cout << "Solution cost: " << totalCost << std::endl;
+            std::cout << "-----------------------------------------" << std::endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include "ExternalStorage.h"
+
+#include <algorithm>
+#include <queue>
+#include <filesystem>
+#include <memory>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
+
+namespace topspin {
+
+namespace {
+
+int compareKeys(const uint8_t* a, const uint8_t* b, const RecordFormat& format) {
+    return std::memcmp(a, b, format.keyBytes);
+}
+
+// Writes records through a buffer and reports short writes, e.g. a full disk.
+class RecordWriter {
+public:
+    RecordWriter(const std::string& path, RecordFormat format) : format(format) {
+        file = std::fopen(path.c_str(), "wb");
+        error = file == nullptr;
+        if (file) std::setvbuf(file, nullptr, _IOFBF, size_t(1) << 20);
+    }
+    ~RecordWriter() { close(); }
+
+    void write(const uint8_t* record) {
+        if (error) return;
+        if (std::fwrite(record, format.width, 1, file) != 1) error = true;
+        written += format.width;
+    }
+
+    bool close() {
+        if (file && std::fclose(file) != 0) error = true;
+        file = nullptr;
+        return !error;
+    }
+
+    bool failed() const { return error; }
+    uint64_t bytesWritten() const { return written; }
+
+private:
+    std::FILE* file = nullptr;
+    RecordFormat format;
+    uint64_t written = 0;
+    bool error = false;
+};
+
+MergeStats mergePass(const std::vector<std::string>& runs, const std::vector<std::string>& exclude,
+                     const std::string& output, RecordFormat format) {
+    MergeStats stats;
+    std::vector<std::unique_ptr<RecordReader>> inputs;
+    std::vector<std::unique_ptr<RecordReader>> excluded;
+    // Every open file gets its own buffer; they shrink with a large fan-in.
+    size_t bufferBytes = std::clamp<size_t>((size_t(128) << 20) / (runs.size() + exclude.size() + 1),
+                                            size_t(64) << 10, size_t(1) << 20);
+    for (const std::string& run : runs) inputs.push_back(std::make_unique<RecordReader>(run, format, bufferBytes));
+    for (const std::string& path : exclude) excluded.push_back(std::make_unique<RecordReader>(path, format, bufferBytes));
+
+    auto greater = [&](size_t a, size_t b) {
+        return compareKeys(inputs[a]->current(), inputs[b]->current(), format) > 0;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (inputs[i]->valid()) heap.push(i);
+    }
+
+    RecordWriter writer(output, format);
+    std::vector<uint8_t> last(format.width);
+    bool haveLast = false;
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+        const uint8_t* record = inputs[i]->current();
+        if (!haveLast || compareKeys(record, last.data(), format) != 0) {
+            std::memcpy(last.data(), record, format.width);
+            haveLast = true;
+            bool found = false;
+            for (auto& other : excluded) {
+                while (other->valid() && compareKeys(other->current(), record, format) < 0) other->next();
+                if (other->valid() && compareKeys(other->current(), record, format) == 0) found = true;
+            }
+            if (!found) {
+                writer.write(record);
+                stats.records++;
+            }
+        }
+        inputs[i]->next();
+        if (inputs[i]->valid()) heap.push(i);
+    }
+
+    stats.failed = !writer.close();
+    for (const auto& input : inputs) stats.failed |= input->failed();
+    for (const auto& other : excluded) stats.failed |= other->failed();
+    stats.bytesWritten = writer.bytesWritten();
+    return stats;
+}
+
+} // namespace
+
+ScratchDirectory::ScratchDirectory(const std::string& parent) {
+    std::string pattern = (parent.empty() ? std::string(".") : parent) + "/topspin-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (mkdtemp(name.data())) {
+        path = name.data();
+    } else {
+        std::cerr << "Could not create a scratch directory in " << parent << std::endl;
+    }
+}
+
+ScratchDirectory::~ScratchDirectory() {
+    if (path.empty()) return;
+    std::error_code error;
+    std::filesystem::remove_all(path, error);
+}
+
+std::string ScratchDirectory::newFile(const std::string& prefix) {
+    return path + "/" + prefix + "-" + std::to_string(counter++);
+}
+
+RecordReader::RecordReader(const std::string& path, RecordFormat format, size_t bufferBytes)
+    : format(format) {
+    size_t records = std::max<size_t>(1, bufferBytes / format.width);
+    buffer.resize(records * format.width);
+    file = std::fopen(path.c_str(), "rb");
+    error = file == nullptr;
+    refill();
+}
+
+RecordReader::~RecordReader() {
+    if (file) std::fclose(file);
+}
+
+void RecordReader::refill() {
+    position = 0;
+    filled = 0;
+    if (!file) return;
+    size_t records = std::fread(buffer.data(), format.width, buffer.size() / format.width, file);
+    if (records == 0 && std::ferror(file)) error = true;
+    filled = records * format.width;
+}
+
+void RecordReader::next() {
+    position += format.width;
+    if (position >= filled) refill();
+}
+
+SortedRunWriter::SortedRunWriter(ScratchDirectory& scratch, RecordFormat format, size_t memoryBytes)
+    : scratch(scratch), format(format) {
+    // The sort permutes 32-bit offsets rather than the records themselves.
+    capacity = std::max<size_t>(1, std::min<size_t>(memoryBytes / (format.width + sizeof(uint32_t)), UINT32_MAX));
+}
+
+void SortedRunWriter::add(const uint8_t* record) {
+    // The buffer grows up to its capacity, so small layers stay cheap.
+    if (count * format.width == buffer.size())
+        buffer.resize(std::min(capacity, std::max<size_t>(4096, 2 * count)) * format.width);
+    std::memcpy(buffer.data() + count * format.width, record, format.width);
+    if (++count == capacity) spill();
+}
+
+void SortedRunWriter::spill() {
+    if (count == 0) return;
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; i++) order[i] = static_cast<uint32_t>(i);
+    const uint8_t* records = buffer.data();
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return compareKeys(records + a * format.width, records + b * format.width, format) < 0;
+    });
+
+    std::string path = scratch.newFile("run");
+    RecordWriter writer(path, format);
+    const uint8_t* last = nullptr;
+    for (uint32_t i : order) {
+        const uint8_t* record = records + size_t(i) * format.width;
+        if (last && compareKeys(record, last, format) == 0) continue;
+        writer.write(record);
+        last = record;
+    }
+    error |= !writer.close();
+    written += writer.bytesWritten();
+    runs.push_back(path);
+    count = 0;
+}
+
+std::vector<std::string> SortedRunWriter::finish() {
+    spill();
+    // Nothing else is added, so the buffer can go before the merge needs memory.
+    std::vector<uint8_t>().swap(buffer);
+    return runs;
+}
+
+MergeStats mergeRuns(ScratchDirectory& scratch, std::vector<std::string> runs,
+                     const std::vector<std::string>& exclude, const std::string& output,
+                     RecordFormat format, size_t maxFanIn) {
+    MergeStats total;
+    maxFanIn = std::max<size_t>(2, maxFanIn);
+    while (runs.size() > maxFanIn) {
+        std::vector<std::string> merged;
+        for (size_t first = 0; first < runs.size(); first += maxFanIn) {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(runs.size(), first + maxFanIn));
+            std::string path = scratch.newFile("merge");
+            MergeStats stats = mergePass(group, {}, path, format);
+            total.bytesWritten += stats.bytesWritten;
+            total.failed |= stats.failed;
+            for (const std::string& run : group) std::remove(run.c_str());
+            merged.push_back(path);
+        }
+        runs = std::move(merged);
+    }
+
+    MergeStats stats = mergePass(runs, exclude, output, format);
+    for (const std::string& run : runs) std::remove(run.c_str());
+    total.records = stats.records;
+    total.bytesWritten += stats.bytesWritten;
+    total.failed |= stats.failed;
+    return total;
+}
+
+bool findRecord(const std::string& path, RecordFormat format, const uint8_t* key, uint8_t* record) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::vector<uint8_t> probe(format.width);
+    uint64_t low = 0;
+    uint64_t high = fileBytes(path) / format.width;
+    bool found = false;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (fseeko(file, static_cast<off_t>(middle * format.width), SEEK_SET) != 0 ||
+            std::fread(probe.data(), format.width, 1, file) != 1) break;
+        int order = compareKeys(probe.data(), key, format);
+        if (order == 0) {
+            if (record) std::memcpy(record, probe.data(), format.width);
+            found = true;
+            break;
+        }
+        if (order < 0) low = middle + 1;
+        else high = middle;
+    }
+    std::fclose(file);
+    return found;
+}
+
+uint64_t fileBytes(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return 0;
+    return static_cast<uint64_t>(info.st_size);
+}
+
+} // namespace topspin
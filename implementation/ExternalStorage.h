@@ -0,0 +1,112 @@
+#ifndef TOPSPIN_EXTERNAL_STORAGE_H
+#define TOPSPIN_EXTERNAL_STORAGE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace topspin {
+
+// Files of fixed-width records kept sorted by their first keyBytes bytes,
+// compared bytewise. The remaining bytes are payload that is carried along
+// and ignored by duplicate detection.
+struct RecordFormat {
+    size_t width;
+    size_t keyBytes;
+};
+
+// Uniquely named directory below parent that is removed, with everything in
+// it, when the object is destroyed.
+class ScratchDirectory {
+public:
+    explicit ScratchDirectory(const std::string& parent);
+    ScratchDirectory(const ScratchDirectory&) = delete;
+    ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+    ~ScratchDirectory();
+
+    bool valid() const { return !path.empty(); }
+    const std::string& directory() const { return path; }
+    // Path of a new file in the directory; the file itself is not created.
+    std::string newFile(const std::string& prefix);
+
+private:
+    std::string path;
+    uint64_t counter = 0;
+};
+
+// Streams the records of a sorted file through a fixed buffer.
+class RecordReader {
+public:
+    RecordReader(const std::string& path, RecordFormat format, size_t bufferBytes = size_t(1) << 20);
+    RecordReader(const RecordReader&) = delete;
+    RecordReader& operator=(const RecordReader&) = delete;
+    ~RecordReader();
+
+    bool valid() const { return position < filled; }
+    const uint8_t* current() const { return buffer.data() + position; }
+    void next();
+    bool failed() const { return error; }
+
+private:
+    void refill();
+
+    std::FILE* file = nullptr;
+    RecordFormat format;
+    std::vector<uint8_t> buffer;
+    size_t position = 0;
+    size_t filled = 0;
+    bool error = false;
+};
+
+// Collects records in a memory buffer of at most memoryBytes. Whenever the
+// buffer is full it is sorted, stripped of duplicate keys and written to a new
+// run file in the scratch directory.
+class SortedRunWriter {
+public:
+    SortedRunWriter(ScratchDirectory& scratch, RecordFormat format, size_t memoryBytes);
+
+    void add(const uint8_t* record);
+    // Writes the buffered records and returns the paths of all runs.
+    std::vector<std::string> finish();
+
+    bool failed() const { return error; }
+    uint64_t bytesWritten() const { return written; }
+
+private:
+    void spill();
+
+    ScratchDirectory& scratch;
+    RecordFormat format;
+    size_t capacity;
+    std::vector<uint8_t> buffer;
+    size_t count = 0;
+    std::vector<std::string> runs;
+    uint64_t written = 0;
+    bool error = false;
+};
+
+struct MergeStats {
+    uint64_t records = 0;
+    uint64_t bytesWritten = 0;
+    bool failed = false;
+};
+
+// Merges sorted runs into the sorted file output, keeping one record per key
+// and dropping every key that also occurs in one of the sorted files in
+// exclude. More than maxFanIn runs are first merged in groups. The runs are
+// deleted; the excluded files are left alone.
+MergeStats mergeRuns(ScratchDirectory& scratch, std::vector<std::string> runs,
+                     const std::vector<std::string>& exclude, const std::string& output,
+                     RecordFormat format, size_t maxFanIn = 128);
+
+// Binary search for key in a sorted file. Copies the matching record to
+// record if it is not null.
+bool findRecord(const std::string& path, RecordFormat format, const uint8_t* key, uint8_t* record = nullptr);
+
+uint64_t fileBytes(const std::string& path);
+
+} // namespace topspin
+
+#endif // TOPSPIN_EXTERNAL_STORAGE_H
@@ -0,0 +1,340 @@
+#include "TopSpinStateSpace.h"
+#include "AbstractionCache.h"
+#include <iostream>
+#include <queue>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <climits>
+#include <unordered_map>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+TopSpinStateSpace::TopSpinState createRandomState(int size, int k, int m) {
+    std::vector<uint8_t> permutation(size);
+    std::iota(permutation.begin(), permutation.end(), 1);
+    TopSpinStateSpace::TopSpinState state(permutation, k);
+
+    std::random_device rd;
+    std::mt19937 rng(rd());
+    std::uniform_int_distribution<int> dist(0, size - 1);
+
+    for (int i = 0; i < m; i++) {
+        int pos = dist(rng);
+        TopSpinStateSpace::TopSpinAction action(pos);
+        action.apply(state);
+    }
+    return state;
+}
+
+// Hash-distributed A*: every state is owned by the worker selected by its hash.
+// Workers keep their own open and closed lists, send generated states to the
+// owner in batches, and stop once no worker holds a node that could improve on
+// the best solution found and no message is in flight.
+class HDAStarSearch {
+private:
+    static constexpr size_t BATCH_SIZE = 64;
+    static constexpr int FLUSH_INTERVAL = 16;
+
+    struct Message {
+        TopSpinStateSpace::TopSpinState state;
+        TopSpinStateSpace::TopSpinState parent;
+        int action;
+        int g;
+    };
+
+    struct OpenEntry {
+        TopSpinStateSpace::TopSpinState state;
+        int g;
+        int f;
+    };
+
+    struct CompareEntries {
+        bool operator()(const OpenEntry& a, const OpenEntry& b) const {
+            if (a.f != b.f) return a.f > b.f;
+            return a.g < b.g;
+        }
+    };
+
+    // Best known g of a state and how it was reached, for path extraction.
+    struct ClosedEntry {
+        int g;
+        int action;
+        TopSpinStateSpace::TopSpinState parent;
+    };
+
+    struct Inbox {
+        mutex lock;
+        vector<Message> messages;
+    };
+
+    struct Worker {
+        priority_queue<OpenEntry, vector<OpenEntry>, CompareEntries> open;
+        unordered_map<TopSpinStateSpace::TopSpinState, ClosedEntry> closed;
+        vector<vector<Message>> outbox;
+        Inbox inbox;
+        long long expanded = 0;
+        long long sent = 0;
+        long long received = 0;
+    };
+
+    int numThreads;
+    function<int(const TopSpinStateSpace::TopSpinState&)> heuristic;
+    vector<unique_ptr<Worker>> workers;
+
+    atomic<int> incumbent{INT_MAX};
+    mutex goalLock;
+    TopSpinStateSpace::TopSpinState goalState;
+
+    // Termination detection: messages flushed but not yet inserted into an
+    // open list, workers without useful work, and an epoch bumped every time
+    // an idle worker becomes busy again.
+    atomic<long long> inFlight{0};
+    atomic<int> idleWorkers{0};
+    atomic<long long> epoch{0};
+    atomic<bool> done{false};
+
+    int owner(const TopSpinStateSpace::TopSpinState& state) const {
+        return static_cast<int>(state.hash() % numThreads);
+    }
+
+    void flush(Worker& worker, int target) {
+        vector<Message>& batch = worker.outbox[target];
+        if (batch.empty()) return;
+        Inbox& inbox = workers[target]->inbox;
+        inFlight += static_cast<long long>(batch.size());
+        worker.sent += batch.size();
+        {
+            lock_guard<mutex> guard(inbox.lock);
+            if (inbox.messages.empty()) {
+                inbox.messages.swap(batch);
+            } else {
+                inbox.messages.insert(inbox.messages.end(), batch.begin(), batch.end());
+            }
+        }
+        batch.clear();
+    }
+
+    void flushAll(Worker& worker) {
+        for (int t = 0; t < numThreads; t++) flush(worker, t);
+    }
+
+    // Inserts a generated state into the owner's lists if it improves on the
+    // best known path to it.
+    void insert(Worker& worker, Message& message) {
+        auto it = worker.closed.find(message.state);
+        if (it != worker.closed.end() && it->second.g <= message.g) return;
+
+        int h = heuristic(message.state);
+        if (h == INT_MAX) return;
+        worker.closed[message.state] = {message.g, message.action, message.parent};
+        worker.open.push({std::move(message.state), message.g, message.g + h});
+    }
+
+    size_t receive(Worker& worker) {
+        vector<Message> messages;
+        {
+            lock_guard<mutex> guard(worker.inbox.lock);
+            messages.swap(worker.inbox.messages);
+        }
+        for (Message& message : messages) insert(worker, message);
+        worker.received += messages.size();
+        return messages.size();
+    }
+
+    bool hasWork(const Worker& worker) const {
+        return !worker.open.empty() && worker.open.top().f < incumbent.load();
+    }
+
+    void expand(Worker& worker, int self) {
+        OpenEntry entry = worker.open.top();
+        worker.open.pop();
+
+        auto it = worker.closed.find(entry.state);
+        if (it != worker.closed.end() && it->second.g < entry.g) return;
+
+        if (stateSpace.is_Goal(entry.state)) {
+            lock_guard<mutex> guard(goalLock);
+            if (entry.g < incumbent.load()) {
+                incumbent = entry.g;
+                goalState = entry.state;
+            }
+            return;
+        }
+
+        worker.expanded++;
+        for (auto& [action, succState] : stateSpace.successors(entry.state)) {
+            int g = entry.g + action.cost();
+            if (g >= incumbent.load()) continue;
+            Message message{std::move(succState), entry.state, action.rotate, g};
+            int target = owner(message.state);
+            if (target == self) {
+                insert(worker, message);
+            } else {
+                worker.outbox[target].push_back(std::move(message));
+                if (worker.outbox[target].size() >= BATCH_SIZE) flush(worker, target);
+            }
+        }
+    }
+
+    bool terminated() {
+        long long before = epoch.load();
+        if (idleWorkers.load() != numThreads) return false;
+        if (inFlight.load() != 0) return false;
+        return epoch.load() == before;
+    }
+
+    void run(int self) {
+        Worker& worker = *workers[self];
+        bool idle = false;
+        int sinceFlush = 0;
+
+        while (!done.load()) {
+            if (idle) {
+                bool hasMessages;
+                {
+                    lock_guard<mutex> guard(worker.inbox.lock);
+                    hasMessages = !worker.inbox.messages.empty();
+                }
+                if (!hasMessages) {
+                    if (terminated()) done = true;
+                    else this_thread::yield();
+                    continue;
+                }
+                // Leave the idle count before bumping the epoch, so a check
+                // that still counts this worker as idle sees the new epoch.
+                idleWorkers--;
+                epoch++;
+                idle = false;
+            }
+
+            inFlight -= static_cast<long long>(receive(worker));
+
+            if (hasWork(worker)) {
+                expand(worker, self);
+                if (++sinceFlush >= FLUSH_INTERVAL) {
+                    flushAll(worker);
+                    sinceFlush = 0;
+                }
+                continue;
+            }
+
+            flushAll(worker);
+            sinceFlush = 0;
+            idle = true;
+            idleWorkers++;
+        }
+    }
+
+    vector<TopSpinStateSpace::TopSpinActionStatePair> extract_path() const {
+        vector<TopSpinStateSpace::TopSpinActionStatePair> path;
+        TopSpinStateSpace::TopSpinState state = goalState;
+        while (true) {
+            const ClosedEntry& entry = workers[owner(state)]->closed.at(state);
+            if (entry.action < 0) break;
+            path.push_back(TopSpinStateSpace::TopSpinActionStatePair(TopSpinStateSpace::TopSpinAction(entry.action), state));
+            state = entry.parent;
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+
+public:
+    TopSpinStateSpace stateSpace;
+
+    HDAStarSearch(const TopSpinStateSpace::TopSpinState& initialState, int threads)
+        : numThreads(max(1, threads)), stateSpace(initialState.size, initialState) {}
+
+    vector<TopSpinStateSpace::TopSpinActionStatePair> run_Algorithm(const string& heuristicName) {
+        heuristic = TopSpinStateSpace::withHeuristic(heuristicName, [this](const auto& policy) {
+            return function<int(const TopSpinStateSpace::TopSpinState&)>([this, policy](const TopSpinStateSpace::TopSpinState& state) {
+                return policy.value(stateSpace, state, policy.data(stateSpace, state));
+            });
+        });
+        workers.clear();
+        for (int t = 0; t < numThreads; t++) {
+            workers.push_back(make_unique<Worker>());
+            workers.back()->outbox.resize(numThreads);
+        }
+        incumbent = INT_MAX;
+        inFlight = 0;
+        idleWorkers = 0;
+        epoch = 0;
+        done = false;
+
+        TopSpinStateSpace::TopSpinState initialState = stateSpace.getInitialState();
+        Message root{initialState, initialState, -1, 0};
+        insert(*workers[owner(initialState)], root);
+
+        vector<thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back(&HDAStarSearch::run, this, t);
+        }
+        for (thread& t : threads) t.join();
+
+        if (incumbent.load() == INT_MAX) return {};
+        return extract_path();
+    }
+
+    void runSearchAlgorithm(const string& heuristicName) {
+        using namespace std::chrono;
+
+        auto timeStart = high_resolution_clock::now();
+        vector<TopSpinStateSpace::TopSpinActionStatePair> solution = run_Algorithm(heuristicName);
+        auto timeEnd = high_resolution_clock::now();
+
+        TopSpinStateSpace::TopSpinState initialState = stateSpace.getInitialState();
+        cout << "Initial State: " << initialState << "| h = " << stateSpace.h(initialState, heuristicName) << endl;
+
+        double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+        cout << elapsedSeconds << " seconds search time" << endl;
+
+        long long expandedNodes = 0;
+        for (int t = 0; t < numThreads; t++) {
+            const Worker& worker = *workers[t];
+            expandedNodes += worker.expanded;
+            cout << "Thread " << t << ": expanded " << worker.expanded
+                 << ", sent " << worker.sent << ", received " << worker.received << endl;
+        }
+        cout << "Number of expanded nodes: " << expandedNodes << endl;
+        topspin::printAbstractionCacheStats();
+
+        if (solution.empty() && incumbent.load() != 0) {
+            cout << "No solution" << endl;
+        } else {
+            int totalCost = 0;
+            for (const auto& pair : solution) {
+                totalCost += pair.action.cost();
+            }
+            cout << "Solution length: " << solution.size() << endl;
+            cout << "Solution cost: " << totalCost << endl;
+            cout << "-----------------------------------------" << endl;
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " n k m h [threads]\n";
+        return 1;
+    }
+
+    int n = std::atoi(argv[1]);
+    int k = std::atoi(argv[2]);
+    int m = std::atoi(argv[3]);
+    string heuristic = argv[4];
+    int threads = argc > 5 ? std::atoi(argv[5]) : static_cast<int>(std::thread::hardware_concurrency());
+    TopSpinStateSpace::TopSpinState initialState = createRandomState(n, k, m);
+    HDAStarSearch search(initialState, threads);
+    search.runSearchAlgorithm(heuristic);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "TopSpinStateSpace.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <cstdint>
+#include <type_traits>
+
+using namespace std;
+
+// Generates the successors of every state on a seeded random walk and scores
+// each of them with evaluate(parent, parentData, action, successor). Reports
+// the number of scored nodes per second and the sum of all h values, which
+// must agree between the dispatch modes.
+template <typename Evaluate>
+void benchmark(const string& mode, const TopSpinStateSpace& stateSpace, int expansions,
+               uint64_t seed, int initialData, Evaluate evaluate) {
+    using namespace std::chrono;
+
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> dist(0, stateSpace.n - 1);
+    TopSpinStateSpace::TopSpinState state = stateSpace.getInitialState();
+    int data = initialData;
+    long long generated = 0;
+    long long checksum = 0;
+
+    auto timeStart = high_resolution_clock::now();
+    for (int i = 0; i < expansions; i++) {
+        int next = dist(rng);
+        int nextData = data;
+        for (const auto& [action, succState] : stateSpace.successors(state)) {
+            int childData = data;
+            checksum += evaluate(state, data, action, succState, childData);
+            generated++;
+            if (action.rotate == next) nextData = childData;
+        }
+        TopSpinStateSpace::TopSpinAction(next).apply(state);
+        data = nextData;
+    }
+    auto timeEnd = high_resolution_clock::now();
+
+    double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+    cout << mode << ": " << generated / elapsedSeconds << " nodes/sec ("
+         << generated << " nodes, " << elapsedSeconds << " seconds, h sum " << checksum << ")" << endl;
+}
+
+// Same walk, with every state's successors scored in one batch call.
+template <typename Policy>
+void benchmarkBatch(const TopSpinStateSpace& stateSpace, int expansions, uint64_t seed, const Policy& policy) {
+    using namespace std::chrono;
+
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> dist(0, stateSpace.n - 1);
+    TopSpinStateSpace::TopSpinState state = stateSpace.getInitialState();
+    vector<int> values(stateSpace.n);
+    long long generated = 0;
+    long long checksum = 0;
+
+    auto timeStart = high_resolution_clock::now();
+    for (int i = 0; i < expansions; i++) {
+        policy.successorValues(stateSpace, state, false, -1, values.data());
+        for (int h : values) checksum += h;
+        generated += stateSpace.n;
+        TopSpinStateSpace::TopSpinAction(dist(rng)).apply(state);
+    }
+    auto timeEnd = high_resolution_clock::now();
+
+    double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+    cout << "batch: " << generated / elapsedSeconds << " nodes/sec ("
+         << generated << " nodes, " << elapsedSeconds << " seconds, h sum " << checksum << ")" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " n k h [expansions=E] [seed=S]\n";
+        return 1;
+    }
+
+    int n = std::atoi(argv[1]);
+    int k = std::atoi(argv[2]);
+    string heuristic = argv[3];
+    int expansions = 100000;
+    uint64_t seed = 1;
+    for (int i = 4; i < argc; i++) {
+        string option = argv[i];
+        if (option.rfind("expansions=", 0) == 0) expansions = std::atoi(option.c_str() + 11);
+        else if (option.rfind("seed=", 0) == 0) seed = std::strtoull(option.c_str() + 5, nullptr, 10);
+    }
+    TopSpinStateSpace::HeuristicFunc function = TopSpinStateSpace::resolveHeuristic(heuristic);
+    if (!function && !topspin::CompositeHeuristic::get(heuristic)) {
+        std::cerr << "Unknown heuristic " << heuristic << "\n";
+        return 1;
+    }
+
+    vector<uint8_t> permutation(n);
+    iota(permutation.begin(), permutation.end(), 1);
+    TopSpinStateSpace::TopSpinState initialState(permutation, k);
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> dist(0, n - 1);
+    for (int i = 0; i < 10 * n; i++) TopSpinStateSpace::TopSpinAction(dist(rng)).apply(initialState);
+    TopSpinStateSpace stateSpace(n, initialState);
+    // Builds or maps the pattern databases before anything is timed.
+    stateSpace.h(initialState, heuristic);
+
+    // Looks the name up for every node, as the engines used to.
+    benchmark("by name", stateSpace, expansions, seed, -1,
+        [&](const auto&, int, const auto&, const auto& succState, int&) {
+            return stateSpace.h(succState, heuristic);
+        });
+
+    // Calls through the function pointer resolved once; composites have none.
+    if (function) {
+        benchmark("resolved", stateSpace, expansions, seed, -1,
+            [&](const auto&, int, const auto&, const auto& succState, int&) {
+                return stateSpace.h(succState, function);
+            });
+    }
+
+    // The policy the search engines are instantiated with.
+    TopSpinStateSpace::withHeuristic(heuristic, [&](const auto& policy) {
+        benchmark("policy", stateSpace, expansions, seed, policy.data(stateSpace, initialState),
+            [&](const auto& state, int data, const auto& action, const auto& succState, int& childData) {
+                childData = policy.childData(stateSpace, state, data, action);
+                return policy.value(stateSpace, succState, childData);
+            });
+        if constexpr (std::decay_t<decltype(policy)>::BATCHED) {
+            benchmarkBatch(stateSpace, expansions, seed, policy);
+        }
+        return 0;
+    });
+    return 0;
+}
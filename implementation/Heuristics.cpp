@@ -1,47 +1,122 @@
 #include "Heuristics.h"
 #include "Abstraction.h"
+#include "PatternDatabase.h"
+#include "Profiling.h"
 #include <vector>
 #include <functional>
 #include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <unordered_map>
-#include <unordered_set>
 #include <cstdint>
 #include <queue>
 #include <climits>
-#include <random>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
 
 namespace topspin {
 
-static int denom = 0;
+// Cache namespace of an abstraction for reversal size k.
+static uint32_t cacheSpace(const AbstractionId& id, int k) {
+    return static_cast<uint32_t>(id.family) << 25 | static_cast<uint32_t>(id.compressed) << 24 |
+           static_cast<uint32_t>(id.param) << 16 | static_cast<uint32_t>(id.index) << 8 | static_cast<uint32_t>(k);
+}
+
+// Every token contributes the circular distance between its offset
+// (position - goal position) and the rotation of the goal it is compared with,
+// so the sums for all n rotations follow from a histogram of the offsets.
+// Moving on to the next rotation brings the tokens whose offset lies in the
+// half circle ahead one step closer and moves all others one step away, apart
+// from the single opposite offset when n is odd.
+static int bestRotationSum(const int* histogram, int sum, int n) {
+    // prefix[i] counts the offsets below i on two laps of the circle.
+    int prefix[2 * 256 + 1];
+    prefix[0] = 0;
+    for (int i = 0; i < 2 * n; i++) {
+        prefix[i + 1] = prefix[i] + histogram[i < n ? i : i - n];
+    }
+
+    const int half = n / 2;
+    int best = sum;
+    for (int rot = 0; rot + 1 < n; rot++) {
+        int closer = prefix[rot + half + 1] - prefix[rot + 1];
+        int opposite = rot + half + 1;
+        int unchanged = n % 2 ? histogram[opposite < n ? opposite : opposite - n] : 0;
+        sum += n - 2 * closer - unchanged;
+        best = std::min(best, sum);
+    }
+    return best;
+}
+
+// A reversal of k tokens moves the i-th token of the window by |k - 1 - 2i|.
+static int reversalDisplacement(int k) {
+    int denom = 0;
+    for (int i = 0; i < k; i++) {
+        denom += std::abs(i - (k - 1 - i));
+    }
+    return denom;
+}
+
+static int circularOffset(int position, int token, int n) {
+    int offset = position - (token - 1);
+    return offset < 0 ? offset + n : offset;
+}
 
 int circularManhattanHeuristic(const std::vector<uint8_t>& state, int k) {
-    static int denom = 0;
+    TOPSPIN_PROFILE_SCOPE("heuristic.manhattan");
     const int n = static_cast<int>(state.size());
-    int best = INT_MAX;
+    int histogram[256] = {};
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        int offset = circularOffset(i, state[i], n);
+        histogram[offset]++;
+        sum += std::min(offset, n - offset);
+    }
+    int denom = reversalDisplacement(k);
+    return (bestRotationSum(histogram, sum, n) + denom - 1) / denom;
+}
 
-    for (int rot = 0; rot < n; rot++) {
-        int count = 0;
-        for (int i = 0; i < n; i++) {
-            int tile = state[(i + rot) % n];
-            int goal_pos = tile - 1;
-            int dist = std::min((i - goal_pos + n) % n, (goal_pos - i + n) % n);
-            count += dist;
-        }
-        best = std::min(best, count);
+// The parent's histogram is updated for the k tokens in each window and put
+// back afterwards. Rotating a successor adds the same amount to every offset,
+// which only renumbers the rotations the minimum is taken over, so rotated
+// successors are scored unrotated.
+void circularManhattanHeuristicBatch(const SuccessorBatch& batch, int k, int* out) {
+    TOPSPIN_PROFILE_SCOPE("heuristic.manhattanBatch");
+    const int n = batch.n;
+    const std::vector<uint8_t>& parent = batch.parent;
+    int histogram[256] = {};
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        int offset = circularOffset(i, parent[i], n);
+        histogram[offset]++;
+        sum += std::min(offset, n - offset);
     }
+    int denom = reversalDisplacement(k);
 
-    if (denom == 0) {
-        for (int i = 0; i < k; i++) {
-            denom += std::abs(i - (k - 1 - i));
+    for (int s = 0; s < batch.count; s++) {
+        if (s == batch.skip) continue;
+        int childSum = sum;
+        for (int j = 0; j < k; j++) {
+            int position = batch.window(s, j);
+            int before = circularOffset(position, parent[position], n);
+            int after = circularOffset(position, parent[batch.source(s, j)], n);
+            histogram[before]--;
+            histogram[after]++;
+            childSum += std::min(after, n - after) - std::min(before, n - before);
+        }
+        out[s] = (bestRotationSum(histogram, childSum, n) + denom - 1) / denom;
+        for (int j = 0; j < k; j++) {
+            int position = batch.window(s, j);
+            histogram[circularOffset(position, parent[batch.source(s, j)], n)]--;
+            histogram[circularOffset(position, parent[position], n)]++;
         }
     }
-
-    return static_cast<int>(std::ceil(best / static_cast<double>(denom)));
 }
 
 int gapHeuristic(const std::vector<uint8_t>& state, int k) {
+    TOPSPIN_PROFILE_SCOPE("heuristic.gap");
     int n = static_cast<int>(state.size());
     int count = 0;
     for (int i = 0; i < n; i++) {
@@ -57,179 +132,460 @@ int gapHeuristic(const std::vector<uint8_t>& state, int k) {
     return static_cast<int>(std::ceil(count / 2.0));
 }
 
+using Predicate = std::function<bool(const uint8_t&)>;
+using Mapping = std::function<int(uint8_t)>;
+
+// Tokens of group g when 1..n is split into numGroups ranges; the last group
+// also takes the remainder.
+static Predicate groupPredicate(int n, int numGroups, int g) {
+    int bound = (n + 1) / numGroups;
+    return [g, bound, numGroups, n](int x) {
+        if (g == numGroups - 1) {
+            return x > g * bound && x <= n;
+        } else {
+            return x > g * bound && x <= (g + 1) * bound;
+        }
+    };
+}
+
+static Predicate modPredicate(int mod, int m) {
+    return [m, mod](int x) { return x % mod == m; };
+}
+
+static Mapping groupMapping(int n, int numGroups) {
+    int bound = (n + 1) / numGroups;
+    return [bound, numGroups](int x) {
+        int group = (x - 1) / bound + 1;
+        if (group > numGroups) group = numGroups;
+        return group;
+    };
+}
+
+static Mapping modMapping(int mod) {
+    return [mod](int x) { return x % mod; };
+}
+
 int groupHeuristic(const std::vector<uint8_t>& state, int k, int numGroups) {
+    TOPSPIN_PROFILE_SCOPE("heuristic.group");
     int n = static_cast<int>(state.size());
-    int bound = (n + 1) / numGroups;
     std::vector<int> h(numGroups, 0);
 
     for (int g = 0; g < numGroups; g++) {
-        auto predicate = [g, bound, numGroups, n](int x) {
-            if (g == numGroups - 1) {
-                return x > g * bound && x <= n;
-            } else {
-                return x > g * bound && x <= (g + 1) * bound;
-            }
-        };
+        Predicate predicate = groupPredicate(n, numGroups, g);
+        AbstractionId id{AbstractionFamily::Group, false, static_cast<uint8_t>(numGroups), static_cast<uint8_t>(g)};
+        if (const PatternDatabase* pdb = getPatternDatabase(id, n, k, predicate)) {
+            h[g] = pdb->lookup(state);
+            continue;
+        }
         std::vector<uint8_t> abstraction = topspin::abstract_state(state, predicate);
-        h[g] = topspin::getSolutionLength(abstraction, k);
+        h[g] = topspin::getSolutionLength(abstraction, k, cacheSpace(id, k));
     }
     return *std::max_element(h.begin(), h.end());
 }
 
 int modDistance(const std::vector<uint8_t>& state, int k, int mod) {
+    TOPSPIN_PROFILE_SCOPE("heuristic.mod");
+    int n = static_cast<int>(state.size());
     std::vector<int> h(mod, 0);
     for (int m = 0; m < mod; m++) {
-        auto predicate = [m, mod](int x) { return x % mod == m; };
+        Predicate predicate = modPredicate(mod, m);
+        AbstractionId id{AbstractionFamily::Mod, false, static_cast<uint8_t>(mod), static_cast<uint8_t>(m)};
+        if (const PatternDatabase* pdb = getPatternDatabase(id, n, k, predicate)) {
+            h[m] = pdb->lookup(state);
+            continue;
+        }
         std::vector<uint8_t> abstraction = topspin::abstract_state(state, predicate);
-        h[m] = topspin::getSolutionLength(abstraction, k);
+        h[m] = topspin::getSolutionLength(abstraction, k, cacheSpace(id, k));
     }
     return *std::max_element(h.begin(), h.end());
 }
 
 int groupHeuristicC(const std::vector<uint8_t>& state, int k, int numGroups) {
+    TOPSPIN_PROFILE_SCOPE("heuristic.groupC");
     int n = static_cast<int>(state.size());
-    int bound = (n + 1) / numGroups;
-    auto mapping = [bound, numGroups, n](int x) {
-        int group = (x - 1) / bound + 1;
-        if (group > numGroups) group = numGroups;
-        return group;
-    };
+    Mapping mapping = groupMapping(n, numGroups);
+    AbstractionId id{AbstractionFamily::Group, true, static_cast<uint8_t>(numGroups), 0};
+    if (const PatternDatabase* pdb = getPatternDatabaseC(id, n, k, mapping)) {
+        return pdb->lookup(state);
+    }
     std::vector<uint8_t> abstraction = topspin::abstract_stateC(state, mapping);
-    int h = topspin::getSolutionLengthC(abstraction, k, mapping);
+    int h = topspin::getSolutionLengthC(abstraction, k, mapping, cacheSpace(id, k));
     return h;
 }
 
 int modDistanceC(const std::vector<uint8_t>& state, int k, int mod) {
-    auto mapping = [mod](int x) { return x % mod; };
+    TOPSPIN_PROFILE_SCOPE("heuristic.modC");
+    int n = static_cast<int>(state.size());
+    Mapping mapping = modMapping(mod);
+    AbstractionId id{AbstractionFamily::Mod, true, static_cast<uint8_t>(mod), 0};
+    if (const PatternDatabase* pdb = getPatternDatabaseC(id, n, k, mapping)) {
+        return pdb->lookup(state);
+    }
     std::vector<uint8_t> abstraction = topspin::abstract_stateC(state, mapping);
-    int h = topspin::getSolutionLengthC(abstraction, k, mapping);
+    int h = topspin::getSolutionLengthC(abstraction, k, mapping, cacheSpace(id, k));
     return h;
 }
 
-// Breakpoint heuristic
-struct pair_hash {
-    template <class T1, class T2>
-    std::size_t operator() (const std::pair<T1,T2>& p) const {
-        auto h1 = std::hash<T1>{}(p.first);
-        auto h2 = std::hash<T2>{}(p.second);
-        return h1 ^ (h2 << 1);
-    }
+static const std::map<std::string, AbstractionId> compositeParts = {
+    {"twoGroup", {AbstractionFamily::Group, false, 2, 0}},
+    {"threeGroup", {AbstractionFamily::Group, false, 3, 0}},
+    {"fourGroup", {AbstractionFamily::Group, false, 4, 0}},
+    {"fiveGroup", {AbstractionFamily::Group, false, 5, 0}},
+    {"oddEven", {AbstractionFamily::Mod, false, 2, 0}},
+    {"threeDistance", {AbstractionFamily::Mod, false, 3, 0}},
+    {"fourDistance", {AbstractionFamily::Mod, false, 4, 0}},
+    {"twoGroupC", {AbstractionFamily::Group, true, 2, 0}},
+    {"threeGroupC", {AbstractionFamily::Group, true, 3, 0}},
+    {"fourGroupC", {AbstractionFamily::Group, true, 4, 0}},
+    {"oddEvenC", {AbstractionFamily::Mod, true, 2, 0}},
+    {"threeDistanceC", {AbstractionFamily::Mod, true, 3, 0}},
+    {"fourDistanceC", {AbstractionFamily::Mod, true, 4, 0}},
 };
 
-int breakpointCalculation(const std::vector<uint8_t>& state, int k) {
-    int n = static_cast<int>(state.size());
-    std::vector<int> p(n + 2);
-    p[0] = 0;
-    for (int i = 0; i < n; i++) p[i + 1] = state[i];
-    p[n + 1] = n + 1;
-    n = p.size();
-
-    using Graph = std::unordered_map<int, std::unordered_map<std::string, std::unordered_set<int>>>;
-    Graph graph;
-    int black_edges = 0;
-
-    for (int i = 0; i < n - 1; i++) {
-        int u = p[i], v = p[i + 1];
-        if (std::abs(u - v) != 1) {
-            graph[u]["black"].insert(v);
-            graph[v]["black"].insert(u);
-            graph[u]["gray"].insert(u + 1);
-            if (u != 0) graph[u]["gray"].insert(u - 1);
-            if (v != n - 1) graph[v]["gray"].insert(v + 1);
-            graph[v]["gray"].insert(v - 1);
-            black_edges++;
-        }
-    }
-
-    for (int i = 0; i < n - 1; i++) {
-        int u = p[i], v = p[i + 1];
-        if (std::abs(u - v) == 1) {
-            graph[u]["gray"].erase(v);
-            graph[v]["gray"].erase(u);
-        }
-    }
-    int cycle_count = 0;
-    auto cleanUpGraph = [](Graph& g) {
-        std::vector<int> to_remove;
-        for (auto& [node, edges] : g)
-            if (edges["black"].empty() || edges["gray"].empty())
-                to_remove.push_back(node);
-        for (int node : to_remove) g.erase(node);
-    };
+const CompositeHeuristic* CompositeHeuristic::get(const std::string& name) {
+    bool dual;
+    if (name.rfind("max:", 0) == 0) dual = false;
+    else if (name.rfind("maxDual:", 0) == 0) dual = true;
+    else return nullptr;
 
-    std::function<bool(Graph&, std::vector<int>&, int, bool, int&)> findKCycleFrom =
-        [&](Graph& g, std::vector<int>& path, int k, bool use_black, int& count) {
-            int current = path.back();
-            if (path.size() == k) {
-                if (!use_black && g[current]["gray"].count(path[0])) {
-                    for (int i = 0; i < k; ++i) {
-                        int u = path[i], v = path[(i + 1) % k];
-                        std::string c = (i % 2 == 0) ? "black" : "gray";
-                        g[u][c].erase(v);
-                        g[v][c].erase(u);
-                    }
-                    count++;
-                    return true;
-                }
-                return false;
+    static std::mutex registryLock;
+    static std::map<std::string, std::unique_ptr<CompositeHeuristic>> registry;
+    std::lock_guard<std::mutex> guard(registryLock);
+    auto it = registry.find(name);
+    if (it != registry.end()) return it->second.get();
+
+    auto composite = std::unique_ptr<CompositeHeuristic>(new CompositeHeuristic());
+    composite->dual = dual;
+    std::stringstream parts(name.substr(name.find(':') + 1));
+    std::string part;
+    while (std::getline(parts, part, ',')) {
+        auto found = compositeParts.find(part);
+        if (found == compositeParts.end()) return nullptr;
+        composite->parts.push_back(found->second);
+    }
+    if (composite->parts.empty()) return nullptr;
+    return registry.emplace(name, std::move(composite)).first->second.get();
+}
+
+const std::vector<CompositeHeuristic::Component>& CompositeHeuristic::components(int n, int k) const {
+    // Searches evaluate one (n, k) at a time, so every thread remembers the
+    // list it used last and only takes the lock when that changes.
+    thread_local const CompositeHeuristic* owner = nullptr;
+    thread_local int ownerN = 0;
+    thread_local int ownerK = 0;
+    thread_local const std::vector<Component>* cached = nullptr;
+    if (owner == this && ownerN == n && ownerK == k) return *cached;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto [it, inserted] = resolved.try_emplace({n, k});
+    if (inserted) {
+        for (const AbstractionId& part : parts) {
+            if (part.compressed) {
+                Mapping mapping = part.family == AbstractionFamily::Group ? groupMapping(n, part.param) : modMapping(part.param);
+                it->second.push_back({part, getPatternDatabaseC(part, n, k, mapping), nullptr, mapping});
+                continue;
+            }
+            for (int index = 0; index < part.param; index++) {
+                AbstractionId id = part;
+                id.index = static_cast<uint8_t>(index);
+                Predicate predicate = part.family == AbstractionFamily::Group
+                    ? groupPredicate(n, part.param, index) : modPredicate(part.param, index);
+                it->second.push_back({id, getPatternDatabase(id, n, k, predicate), predicate, nullptr});
             }
-            const auto& edges = g[current][use_black ? "black" : "gray"];
-            for (int neighbor : edges) {
-                if (std::find(path.begin(), path.end(), neighbor) != path.end()) continue;
-                path.push_back(neighbor);
-                if (findKCycleFrom(g, path, k, !use_black, count)) return true;
-                path.pop_back();
+        }
+    }
+    owner = this;
+    ownerN = n;
+    ownerK = k;
+    cached = &it->second;
+    return it->second;
+}
+
+void CompositeHeuristic::Views::load(const uint8_t* state, int n, bool dual) {
+    permutation.assign(state, state + n);
+    positionOf.resize(n + 1);
+    if (dual) {
+        inverse.resize(n);
+        inversePositionOf.resize(n + 1);
+    }
+    for (int i = 0; i < n; i++) set(i, state[i], dual);
+}
+
+void CompositeHeuristic::Views::set(int position, uint8_t token, bool dual) {
+    permutation[position] = token;
+    positionOf[token] = static_cast<uint8_t>(position);
+    if (dual) {
+        inverse[token - 1] = static_cast<uint8_t>(position + 1);
+        inversePositionOf[position + 1] = static_cast<uint8_t>(token - 1);
+    }
+}
+
+int CompositeHeuristic::evaluate(const Views& views, const std::vector<Component>& list, int k) const {
+    // The padded tables only need the position of each of their tokens, which
+    // is computed once per permutation for all of them.
+    int best = -1;
+    for (int view = 0; view < (dual ? 2 : 1); view++) {
+        const std::vector<uint8_t>& permutation = view == 0 ? views.permutation : views.inverse;
+        const uint8_t* positionOf = view == 0 ? views.positionOf.data() : views.inversePositionOf.data();
+
+        for (const Component& component : list) {
+            int h;
+            if (component.pdb && !component.id.compressed) {
+                h = component.pdb->lookupPositions(positionOf);
+            } else if (component.pdb) {
+                h = component.pdb->lookup(permutation);
+            } else if (!component.id.compressed) {
+                std::vector<uint8_t> abstraction = topspin::abstract_state(permutation, component.predicate);
+                h = topspin::getSolutionLength(abstraction, k, cacheSpace(component.id, k));
+            } else {
+                std::vector<uint8_t> abstraction = topspin::abstract_stateC(permutation, component.mapping);
+                h = topspin::getSolutionLengthC(abstraction, k, component.mapping, cacheSpace(component.id, k));
             }
-            return false;
-        };
+            best = std::max(best, h);
+        }
+    }
+    return best;
+}
+
+int CompositeHeuristic::evaluate(const std::vector<uint8_t>& state, int k) const {
+    TOPSPIN_PROFILE_SCOPE("heuristic.composite");
+    const int n = static_cast<int>(state.size());
+    thread_local Views views;
+    views.load(state.data(), n, dual);
+    return evaluate(views, components(n, k), k);
+}
+
+void CompositeHeuristic::evaluateBatch(const SuccessorBatch& batch, int k, int* out) const {
+    TOPSPIN_PROFILE_SCOPE("heuristic.compositeBatch");
+    const int n = batch.n;
+    const std::vector<Component>& list = components(n, k);
+    thread_local Views views;
+    thread_local Views rotatedViews;
+    thread_local std::vector<uint8_t> rotated;
+    views.load(batch.parent.data(), n, dual);
+    for (int s = 0; s < batch.count; s++) {
+        if (s == batch.skip) continue;
+        // Abstract distances do not change when a state is rotated, so a
+        // rotated successor is scored unrotated. Its inverse is not a
+        // rotation of the unrotated one's, though, so dual composites read
+        // the successor itself.
+        if (batch.offset[s] && dual) {
+            rotated.resize(n);
+            for (int i = 0; i < n; i++) rotated[i] = batch.token(s, i);
+            rotatedViews.load(rotated.data(), n, dual);
+            out[s] = evaluate(rotatedViews, list, k);
+            continue;
+        }
+        for (int j = 0; j < k; j++) views.set(batch.window(s, j), batch.parent[batch.source(s, j)], dual);
+        out[s] = evaluate(views, list, k);
+        for (int j = 0; j < k; j++) views.set(batch.window(s, j), batch.parent[batch.window(s, j)], dual);
+    }
+}
+
+// Breakpoint heuristic
+namespace {
+
+// Breakpoint graph of p = 0, state, n + 1 on the values 0..n+1. Black edges
+// join neighbours in p that are not consecutive values, so a node has at most
+// a black edge to its predecessor and one to its successor in p. Gray edges
+// join consecutive values and leave the endpoints of black edges only, so they
+// are directed. Each node keeps its edges as flags.
+enum : uint8_t { BLACK_PREV = 1, BLACK_NEXT = 2, GRAY_DOWN = 4, GRAY_UP = 8 };
+constexpr uint8_t BLACK = BLACK_PREV | BLACK_NEXT;
+constexpr uint8_t GRAY = GRAY_DOWN | GRAY_UP;
+constexpr int MAX_CYCLE = 20;
+
+// Scratch space reused by every evaluation on a thread; the vectors only
+// grow, so evaluations after the first do not allocate.
+struct BreakpointGraph {
+    int size = 0;
+    int blackEdgeCount = 0;
+    std::vector<int> p;
+    std::vector<int> position;
+    std::vector<uint8_t> initial;
+    std::vector<uint8_t> edges;
+    std::vector<uint8_t> onPath;
+    std::vector<std::pair<int, int>> blackEdges;
+    int path[MAX_CYCLE];
+
+    // Builds the graph of state read from position first onwards.
+    void build(const std::vector<uint8_t>& state, int first) {
+        int n = static_cast<int>(state.size());
+        size = n + 2;
+        p.resize(size);
+        position.resize(size);
+        initial.assign(size, 0);
+        edges.resize(size);
+        onPath.assign(size, 0);
+        p[0] = 0;
+        for (int i = 0; i < n; i++) p[i + 1] = state[(i + first) % n];
+        p[size - 1] = size - 1;
+        for (int i = 0; i < size; i++) position[p[i]] = i;
+
+        blackEdgeCount = 0;
+        for (int i = 0; i < size - 1; i++) {
+            int u = p[i], v = p[i + 1];
+            if (std::abs(u - v) == 1) continue;
+            initial[u] |= BLACK_NEXT | GRAY_UP | (u != 0 ? GRAY_DOWN : 0);
+            initial[v] |= BLACK_PREV | GRAY_DOWN | (v != size - 1 ? GRAY_UP : 0);
+            blackEdgeCount++;
+        }
+        // Gray edges between neighbours in p are not part of the graph.
+        for (int i = 0; i < size - 1; i++) {
+            int u = p[i], v = p[i + 1];
+            if (v == u + 1) {
+                initial[u] &= ~GRAY_UP;
+                initial[v] &= ~GRAY_DOWN;
+            } else if (v == u - 1) {
+                initial[u] &= ~GRAY_DOWN;
+                initial[v] &= ~GRAY_UP;
+            }
+        }
+    }
+
+    int neighbours(int x, bool black, int* out) const {
+        int count = 0;
+        if (black) {
+            if (edges[x] & BLACK_NEXT) out[count++] = p[position[x] + 1];
+            if (edges[x] & BLACK_PREV) out[count++] = p[position[x] - 1];
+        } else {
+            if (edges[x] & GRAY_DOWN) out[count++] = x - 1;
+            if (edges[x] & GRAY_UP) out[count++] = x + 1;
+        }
+        return count;
+    }
+
+    bool hasGray(int x, int y) const {
+        if (y == x + 1) return edges[x] & GRAY_UP;
+        if (y == x - 1) return edges[x] & GRAY_DOWN;
+        return false;
+    }
+
+    void removeBlack(int x, int y) {
+        if (position[y] == position[x] + 1) {
+            edges[x] &= ~BLACK_NEXT;
+            edges[y] &= ~BLACK_PREV;
+        } else {
+            edges[x] &= ~BLACK_PREV;
+            edges[y] &= ~BLACK_NEXT;
+        }
+    }
 
-    auto findKCycles = [&](Graph& g, int k, int& count) {
-        std::vector<std::pair<int,int>> black_edges_list;
+    void removeGray(int x, int y) {
+        if (y == x + 1) {
+            edges[x] &= ~GRAY_UP;
+            edges[y] &= ~GRAY_DOWN;
+        } else {
+            edges[x] &= ~GRAY_DOWN;
+            edges[y] &= ~GRAY_UP;
+        }
+    }
 
-        std::unordered_set<std::pair<int,int>, pair_hash> seen;
-        for (auto& [u, edges] : g) {
-            for (int v : edges["black"]) {
-                if (u < v) black_edges_list.emplace_back(u, v);
+    // Extends the alternating path of the given size to a cycle of length
+    // edges, closed by a gray edge back to path[0]. A cycle that is found is
+    // removed from the graph.
+    bool extend(int pathSize, int length) {
+        int current = path[pathSize - 1];
+        if (pathSize == length) {
+            if (!hasGray(current, path[0])) return false;
+            for (int i = 0; i < length; i++) {
+                int u = path[i], v = path[(i + 1) % length];
+                if (i % 2 == 0) removeBlack(u, v);
+                else removeGray(u, v);
+                onPath[u] = 0;
             }
+            return true;
         }
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::shuffle(black_edges_list.begin(), black_edges_list.end(), gen);
+        int next[2];
+        int count = neighbours(current, pathSize % 2 == 1, next);
+        for (int i = 0; i < count; i++) {
+            if (onPath[next[i]]) continue;
+            onPath[next[i]] = 1;
+            path[pathSize] = next[i];
+            if (extend(pathSize + 1, length)) return true;
+            onPath[next[i]] = 0;
+        }
+        return false;
+    }
 
-        for (auto& [u,v] : black_edges_list) {
-            if (!g.count(u) || !g.count(v)) continue;
+    // Greedily removes alternating cycles of 4, 6, ..., MAX_CYCLE edges,
+    // trying the black edges of each round in an order shuffled from seed.
+    // Nodes left without black or without gray edges drop out between rounds.
+    int countCycles(uint64_t seed) {
+        edges = initial;
+        int cycles = 0;
+        for (int length = 4; length <= MAX_CYCLE; length += 2) {
+            blackEdges.clear();
+            for (int x = 0; x < size; x++) {
+                int next[2];
+                int count = neighbours(x, true, next);
+                for (int i = 0; i < count; i++) {
+                    if (x < next[i]) blackEdges.emplace_back(x, next[i]);
+                }
+            }
+            for (size_t i = blackEdges.size(); i > 1; i--) {
+                seed = mix(seed);
+                std::swap(blackEdges[i - 1], blackEdges[seed % i]);
+            }
 
-            std::vector<int> path = {u, v};
-            int local_count = 0;
+            for (const auto& [u, v] : blackEdges) {
+                path[0] = u;
+                path[1] = v;
+                onPath[u] = onPath[v] = 1;
+                if (extend(2, length)) {
+                    cycles++;
+                } else {
+                    onPath[u] = onPath[v] = 0;
+                }
+            }
 
-            if (findKCycleFrom(g, path, k, false, local_count)) {
-                count += local_count;
+            for (int x = 0; x < size; x++) {
+                if (!(edges[x] & BLACK) || !(edges[x] & GRAY)) edges[x] = 0;
             }
         }
-    };
+        return blackEdgeCount - cycles;
+    }
+
+    uint64_t seed() const {
+        uint64_t h = 0x9e3779b97f4a7c15ULL;
+        for (int i = 0; i < size; i++) h = mix(h ^ static_cast<uint64_t>(p[i]));
+        return h;
+    }
 
-    for (int len = 2; len <= 10; len++) {
-        findKCycles(graph, 2 * len, cycle_count);
-        cleanUpGraph(graph);
+    static uint64_t mix(uint64_t h) {
+        h += 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
     }
-    return black_edges - cycle_count;
+};
+
+thread_local BreakpointGraph breakpointGraph;
+
+} // namespace
+
+// The black edges minus a greedy count of disjoint alternating cycles. The
+// order in which edges are tried is drawn from a seed derived from the state,
+// so the same state always gets the same value.
+int breakpointCalculation(const std::vector<uint8_t>& state, int k) {
+    breakpointGraph.build(state, 0);
+    return breakpointGraph.countCycles(breakpointGraph.seed());
 }
 
+// Minimum over n/4 greedy cycle decompositions of the rotation with 1 first,
+// each trying the edges in a different order.
 int breakpointHeuristic(const std::vector<uint8_t>& state, int k) {
+    TOPSPIN_PROFILE_SCOPE("heuristic.breakpoint");
     int n = static_cast<int>(state.size());
-    int best_h = INT_MAX;
+    auto it1 = std::find(state.begin(), state.end(), 1);
+    if (it1 == state.end()) return INT_MAX;
 
-    for (int i = 0; i < n/4; i++) {
-        // Rotation with 1 at position 0
-        auto it1 = std::find(state.begin(), state.end(), 1);
-        if (it1 != state.end()) {
-            int idx1 = static_cast<int>(std::distance(state.begin(), it1));
-            std::vector<uint8_t> rot1(n);
-            for (int i = 0; i < n; i++)
-                rot1[i] = state[(i + idx1) % n];
-            best_h = std::min(best_h, breakpointCalculation(rot1, k));
-        }
+    breakpointGraph.build(state, static_cast<int>(std::distance(state.begin(), it1)));
+    uint64_t seed = breakpointGraph.seed();
+    int best_h = INT_MAX;
+    for (int i = 0; i < n / 4; i++) {
+        best_h = std::min(best_h, breakpointGraph.countCycles(seed + i));
     }
     return best_h;
 }
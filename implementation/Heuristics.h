@@ -1,14 +1,56 @@
 #ifndef TOPSPIN_HEURISTICS_H
 #define TOPSPIN_HEURISTICS_H
 
+#include "PatternDatabase.h"
 #include <vector>
+#include <string>
+#include <map>
+#include <mutex>
 #include <functional>
 #include <cstdint>
 
 namespace topspin {
-    
+
+// All successors of one state, successor s reached by the reversal at
+// position s, stored structure-of-arrays: row i holds token i of every
+// successor, so a pass over one position reads a single contiguous row.
+// Batch heuristics score every successor in one call and may start from the
+// parent instead, since an unrotated successor differs from it only inside
+// its window; tokens is only filled for those that read the successors.
+// Successors of a canonical parent whose window covers position 0 are rotated
+// back to canonical form, by offset[s] positions to the left. The successor
+// at skip, usually the way back to the parent, is not needed and its score is
+// left undefined.
+struct SuccessorBatch {
+    int n = 0;
+    int k = 0;
+    int count = 0;
+    int skip = -1;
+    std::vector<uint8_t> parent;
+    std::vector<uint8_t> tokens;
+    std::vector<uint8_t> offset;
+
+    const uint8_t* row(int i) const { return tokens.data() + static_cast<size_t>(i) * count; }
+    uint8_t token(int s, int i) const { return row(i)[s]; }
+    // Position in the parent of the token successor s has at window position
+    // j, for an unrotated successor.
+    int source(int s, int j) const {
+        int position = s + k - 1 - j;
+        return position >= n ? position - n : position;
+    }
+    // Position j of the window of successor s.
+    int window(int s, int j) const {
+        int position = s + j;
+        return position >= n ? position - n : position;
+    }
+};
+
+// Scores every successor of a batch into out[0..count).
+using BatchHeuristicFunc = void(*)(const SuccessorBatch&, int, int*);
+
 // Manhatten like heuristic
 int circularManhattanHeuristic(const std::vector<uint8_t>& permutation, int k);
+void circularManhattanHeuristicBatch(const SuccessorBatch& batch, int k, int* out);
 
 // Gap heuristic
 int gapHeuristic(const std::vector<uint8_t>& permutation, int k);
@@ -21,6 +63,57 @@ int modDistance(const std::vector<uint8_t>& permutation, int k, int mod);
 int groupHeuristicC(const std::vector<uint8_t>& permutation, int k, int numGroups);
 int modDistanceC(const std::vector<uint8_t>& permutation, int k, int mod);
 
+// Maximum over several abstraction heuristics, named by listing them, e.g.
+// "max:threeGroup,oddEvenC". "maxDual:..." also evaluates every abstraction on
+// the inverse permutation: reversals commute with rotating the puzzle, so a
+// state and its inverse are equally far from the goal and both values are
+// admissible. Pattern databases are resolved once per (n, k).
+class CompositeHeuristic {
+public:
+    // Shared instance for a composite name, or nullptr if the name is not a
+    // composite or lists an unknown abstraction.
+    static const CompositeHeuristic* get(const std::string& name);
+    int evaluate(const std::vector<uint8_t>& permutation, int k) const;
+    // Same values for every successor of a batch. The position tables of the
+    // parent are patched in the window of each successor and restored, so
+    // an unrotated successor costs O(k) on top of its table lookups.
+    void evaluateBatch(const SuccessorBatch& batch, int k, int* out) const;
+    // Whether evaluateBatch reads the successors' tokens.
+    bool readsSuccessors() const { return dual; }
+
+private:
+    // One abstraction for a given (n, k): its pattern database, or what the
+    // on-demand search needs when the table is too large to build.
+    struct Component {
+        AbstractionId id;
+        const PatternDatabase* pdb;
+        std::function<bool(const uint8_t&)> predicate;
+        std::function<int(uint8_t)> mapping;
+    };
+
+    // One permutation and the position tables its lookups need: positionOf
+    // (indexed by token) and, for dual composites, the inverse permutation
+    // with its own position table.
+    struct Views {
+        std::vector<uint8_t> permutation;
+        std::vector<uint8_t> positionOf;
+        std::vector<uint8_t> inverse;
+        std::vector<uint8_t> inversePositionOf;
+
+        void load(const uint8_t* state, int n, bool dual);
+        void set(int position, uint8_t token, bool dual);
+    };
+
+    CompositeHeuristic() = default;
+    const std::vector<Component>& components(int n, int k) const;
+    int evaluate(const Views& views, const std::vector<Component>& list, int k) const;
+
+    bool dual = false;
+    std::vector<AbstractionId> parts;
+    mutable std::mutex lock;
+    mutable std::map<std::pair<int, int>, std::vector<Component>> resolved;
+};
+
 // Breakpoint heuristic
 int breakpointCalculation(const std::vector<uint8_t>& state, int k);
 int breakpointHeuristic(const std::vector<uint8_t>& state, int k);
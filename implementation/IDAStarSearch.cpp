@@ -1,4 +1,4 @@
-#include "TopSpinStateSpace.h"
+#include "IDAStarSearch.h"
 #include <iostream>
 #include <vector>
 #include <string>
@@ -9,21 +9,15 @@
 #include <random>
 #include <numeric>
 #include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <cmath>
 
 using namespace std;
 
-namespace std {
-    template <>
-    struct hash<TopSpinStateSpace::TopSpinState> {
-        size_t operator()(const TopSpinStateSpace::TopSpinState& state) const {
-            size_t h = 0;
-            for (int x : state.permutation)
-                h ^= hash<int>()(x) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            return h;
-        }
-    };
-}
-
 TopSpinStateSpace::TopSpinState createRandomState(int size, int k, int m) {
     std::vector<uint8_t> permutation(size);
     std::iota(permutation.begin(), permutation.end(), 1);
@@ -41,141 +35,11 @@ TopSpinStateSpace::TopSpinState createRandomState(int size, int k, int m) {
     return state;
 }
 
-class IDAStarSearch {
-public:
-    static const int MAX_NODE_TABLE_ENTRIES = 30000000;
-
-    TopSpinStateSpace stateSpace;
-    long long nodesExpanded = 0;
-    double nextBound = 0.0;
-
-    IDAStarSearch(const TopSpinStateSpace::TopSpinState& initialState)
-        : stateSpace(initialState.size, initialState) {}
-
-    double search(const TopSpinStateSpace::TopSpinState& state,
-                const TopSpinStateSpace::TopSpinState& parent,
-                double g, double bound,
-                const string& heuristic,
-                vector<TopSpinStateSpace::TopSpinActionStatePair>& path,
-                const TopSpinStateSpace::TopSpinState& goal,
-                bool& found,
-                unordered_map<TopSpinStateSpace::TopSpinState, double>& nodeTable)
-    {
-        nodesExpanded++;
-        double h = static_cast<double>(stateSpace.h(state, heuristic));
-        double f = g + h;
-
-        if (f > bound) {
-            updateNextBound(bound, f);
-            return h;
-        }
-
-        if (stateSpace.is_Goal(state)) {
-            found = true;
-            return 0.0;
-        }
-
-        auto it = nodeTable.find(state);
-        if (it != nodeTable.end() && it->second <= g) {
-            return static_cast<double>(stateSpace.h(state, heuristic));
-        }
-
-        if (nodeTable.size() < MAX_NODE_TABLE_ENTRIES) {
-            nodeTable[state] = g;
-        }
-
-        auto successors = stateSpace.successors(state);
-
-        for (auto& pair : successors) {
-            TopSpinStateSpace::TopSpinState nextState = pair.state;
-            if (nextState == parent) continue;
-
-            path.push_back({pair.action, nextState});
-            double edgeCost = static_cast<double>(pair.action.cost());
-            double childH = search(nextState, state, g + edgeCost, bound, heuristic, path, goal, found, nodeTable);
-            if (found) return 0.0;
-            path.pop_back();
-
-            if (childH - edgeCost > h) {
-                h = childH - edgeCost;
-                if (g + h > bound) {
-                    updateNextBound(bound, g + h);
-                    return h;
-                }
-            }
-        }
-        return h;
-    }
-
-    void updateNextBound(double currBound, double fCost) {
-        fCost = floor(fCost);
-        if (nextBound <= currBound)
-            nextBound = fCost;
-        else if (fCost > currBound && fCost < nextBound)
-            nextBound = fCost;
-    }
-
-    void runSearchAlgorithm(const string& heuristic) {
-        using namespace std::chrono;
-
-        TopSpinStateSpace::TopSpinState initial = stateSpace.getInitialState();
-        double bound = static_cast<double>(stateSpace.h(initial, heuristic));
-        nextBound = bound;
-
-        if (bound == static_cast<double>(INT_MAX)) {
-            cout << "No solution found!" << endl;
-            return;
-        }
-
-        auto timeStart = high_resolution_clock::now();
-
-        vector<TopSpinStateSpace::TopSpinActionStatePair> path;
-        vector<TopSpinStateSpace::TopSpinActionStatePair> solution;
-
-        int iteration = 0;
-        bool found = false;
-        while (!found) {
-            unordered_map<TopSpinStateSpace::TopSpinState, double> nodeTable;
-            path.clear();
-            nextBound = 0.0;
-            path.push_back({TopSpinStateSpace::TopSpinAction(-1), initial});
-            double temp = search(initial, initial, 0.0, bound, heuristic, path, initial, found, nodeTable);
-            path.erase(path.begin());
-            iteration++;
-            if (found) {
-                solution = path;
-                break;
-            }
-            if (nextBound == 0.0 || nextBound == bound) {
-                cout << "No solution found" << endl;
-                return;
-            }
-            bound = nextBound;
-        }
-
-        auto timeEnd = high_resolution_clock::now();
-        double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
-        cout << "Initial State: " << initial << "| h = " << stateSpace.h(initial, heuristic) << endl;
-        cout << elapsedSeconds << " seconds search time" << endl;
-        cout << "Nodes expanded: " << nodesExpanded << endl;
-
-        if (solution.empty()) {
-            cout << "No solution" << endl;
-        } else {
-            int totalCost = 0;
-            for (const auto& pair : solution) {
-                totalCost += pair.action.cost();
-            }
-            cout << "Solution length: " << solution.size() << endl;
-            cout << "Total cost: " << totalCost << endl;
-            cout << "-----------------------------------------" << endl;
-        }
-    }
-};
 
 int main(int argc, char* argv[]) {
     if (argc < 5) {
-        std::cerr << "Usage: " << argv[0] << " n k m heuristic\n";
+        std::cerr << "Usage: " << argv[0] << " n k m heuristic [canonical] [prune[=L]] [threads=T] [depth=D] [table=MB]"
+                  << " [checkpoint=path] [interval=seconds] [resume]\n";
         return 1;
     }
 
@@ -183,8 +47,49 @@ int main(int argc, char* argv[]) {
     int k = std::atoi(argv[2]);
     int m = std::atoi(argv[3]);
     string heuristic = argv[4];
+    bool canonical = false;
+    int pruneLength = 0;
+    string checkpointPath;
+    double interval = -1.0;
+    bool resume = false;
+    int threads = 1;
+    int depth = 0;
+    long long tableMB = -1;
+    for (int i = 5; i < argc; i++) {
+        string option = argv[i];
+        if (option == "canonical") canonical = true;
+        else if (option == "resume") resume = true;
+        else if (option.rfind("checkpoint=", 0) == 0) checkpointPath = option.substr(11);
+        else if (option.rfind("interval=", 0) == 0) interval = std::atof(option.c_str() + 9);
+        else if (option == "prune") pruneLength = 2;
+        else if (option.rfind("prune=", 0) == 0) pruneLength = std::atoi(option.c_str() + 6);
+        else if (option.rfind("threads=", 0) == 0) threads = std::atoi(option.c_str() + 8);
+        else if (option.rfind("depth=", 0) == 0) depth = std::atoi(option.c_str() + 6);
+        else if (option.rfind("table=", 0) == 0) tableMB = std::atoll(option.c_str() + 6);
+    }
+    if (canonical && pruneLength > 0) {
+        std::cerr << "Move pruning is disabled in canonical mode\n";
+    }
+    if (resume && checkpointPath.empty()) {
+        std::cerr << "resume needs checkpoint=path\n";
+        return 1;
+    }
     TopSpinStateSpace::TopSpinState initialState = createRandomState(n, k, m);
-    IDAStarSearch search(initialState);
+    if (resume) {
+        // The start state was random; the checkpoint keeps the one it belongs to.
+        topspin::CheckpointReader checkpoint;
+        if (!checkpoint.open(checkpointPath) || checkpoint.header().n != n || checkpoint.header().k != k) {
+            std::cerr << "No checkpoint for n = " << n << ", k = " << k << " in " << checkpointPath << "\n";
+            return 1;
+        }
+        initialState = checkpoint.initialState();
+    }
+    IDAStarSearch search(initialState, canonical, pruneLength);
+    search.setThreads(threads, depth);
+    if (tableMB >= 0) search.tableBytes = static_cast<size_t>(tableMB) << 20;
+    search.checkpointPath = checkpointPath;
+    if (interval >= 0.0) search.checkpointInterval = interval;
+    search.resume = resume;
     search.runSearchAlgorithm(heuristic);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,636 @@
+#ifndef IDASTARSEARCH_H
+#define IDASTARSEARCH_H
+
+#include "TopSpinStateSpace.h"
+#include "MovePruning.h"
+#include "AbstractionCache.h"
+#include "Profiling.h"
+#include "TranspositionTable.h"
+#include "Checkpoint.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <climits>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <cmath>
+#include <cstdint>
+
+class IDAStarSearch {
+public:
+    TopSpinStateSpace stateSpace;
+    long long nodesExpanded = 0;
+    double nextBound = 0.0;
+
+    // Search on rotation-canonical states; see TopSpinStateSpace::canonicalize.
+    bool canonical = false;
+    // Move pruning over sequences of up to this many actions; 0 disables it.
+    // The table orders actions by absolute position, which canonicalization
+    // changes from state to state, so the two are not combined.
+    std::shared_ptr<const topspin::MovePruning> pruning;
+    int pruneLength = 0;
+
+    // Worker threads per iteration; 1 runs the plain recursive search unless
+    // checkpoints are written. Otherwise every iteration expands the tree down
+    // to frontierDepth and the subtrees below are searched from work-stealing
+    // deques.
+    int numThreads = 1;
+    int frontierDepth = 0;
+
+    // Whether search() cuts nodes this iteration already reached at no
+    // higher cost. Under move pruning the earlier path may have been allowed
+    // fewer actions. The recursive search reaches paths of equal cost in
+    // action order, so the path that pruning keeps is never the one cut, but
+    // frontier tasks run in any order and searchParallel turns the cut off.
+    bool cutDuplicates = true;
+
+    // Memory for the transposition tables, split evenly between the threads.
+    // The tables are allocated once per search and kept across iterations;
+    // 0 disables them. Larger tables keep more entries but touch more pages,
+    // which costs more than it saves on problems up to N = 16.
+    size_t tableBytes = size_t(64) << 20;
+    // Entries in use at the end of the search, summed over the tables.
+    uint64_t tableEntries = 0;
+
+    static topspin::TranspositionTable::Key tableKey(const TopSpinStateSpace::TopSpinState& state) {
+        if (state.isPacked()) {
+            return {static_cast<uint64_t>(state.packed), static_cast<uint64_t>(state.packed >> 64)};
+        }
+        // Wide states get a fingerprint from two differently seeded hashes.
+        uint64_t lo = 0x243f6a8885a308d3ULL;
+        uint64_t hi = 0x13198a2e03707344ULL;
+        for (int i = 0; i < state.size; i++) {
+            lo = (lo ^ state.wide[i]) * 0x100000001b3ULL;
+            hi = (hi + state.wide[i] + 1) * 0x9e3779b97f4a7c15ULL;
+            hi ^= hi >> 29;
+        }
+        return {lo, hi};
+    }
+
+    // Checkpoints: with a checkpointPath, every iteration is split into
+    // frontier tasks even on one thread, and at most every
+    // checkpointInterval seconds the bound, the next bound found so far and
+    // the tasks not finished yet are written there, replacing the previous
+    // checkpoint. With resume set, the search continues with the unfinished
+    // tasks of the checkpointed iteration; the transposition tables start
+    // empty, which only costs time.
+    std::string checkpointPath;
+    double checkpointInterval = 300.0;
+    bool resume = false;
+
+    IDAStarSearch(const TopSpinStateSpace::TopSpinState& initialState, bool canonical = false, int pruneLength = 0)
+        : stateSpace(initialState.size, initialState), canonical(canonical), pruneLength(pruneLength) {
+        if (pruneLength > 0 && !canonical)
+            pruning = std::make_shared<topspin::MovePruning>(stateSpace.n, initialState.k, pruneLength);
+    }
+
+    void setThreads(int threads, int depth = 0) {
+        numThreads = std::max(1, threads);
+        frontierDepth = depth;
+        if (frontierDepth <= 0) {
+            // Aim for a few dozen subtrees per thread so stealing can even out
+            // the very different subtree sizes.
+            frontierDepth = 1;
+            double subtrees = stateSpace.n;
+            while (subtrees < 32.0 * numThreads && frontierDepth < 8) {
+                subtrees *= std::max(2, stateSpace.n - 1);
+                frontierDepth++;
+            }
+        }
+    }
+
+    // h of the successors of a node in the current path, n entries per
+    // depth, for batched policies. Grows with the depth only.
+    std::vector<int> successorH;
+
+    // Scores the children of state: all at once into successorH for batched
+    // policies, one by one in childH() otherwise.
+    template <typename Heuristic>
+    void scoreSuccessors(const TopSpinStateSpace::TopSpinState& state, const Heuristic& heuristic, size_t depth,
+                         int parentAction) {
+        if constexpr (Heuristic::BATCHED) {
+            TOPSPIN_PROFILE_SCOPE("idastar.heuristic");
+            size_t needed = (depth + 1) * stateSpace.n;
+            if (successorH.size() < needed) successorH.resize(needed);
+            heuristic.successorValues(stateSpace, state, canonical, parentAction, successorH.data() + depth * stateSpace.n);
+        }
+    }
+
+    // h of the child reached by action, which state now holds.
+    template <typename Heuristic>
+    double childH(const TopSpinStateSpace::TopSpinState& state, const Heuristic& heuristic, size_t depth,
+                  int action, int childGaps) {
+        if constexpr (Heuristic::BATCHED) {
+            return successorH[depth * stateSpace.n + action];
+        } else {
+            TOPSPIN_PROFILE_SCOPE("idastar.heuristic");
+            return static_cast<double>(heuristic.value(stateSpace, state, childGaps));
+        }
+    }
+
+    // Depth-first search below state, which is changed in place while a
+    // child is searched and restored before the next one. path holds the
+    // action positions from the root; parentAction is the position that leads
+    // back to the parent and is skipped. h is the state's heuristic value,
+    // computed by the parent so batched policies can score all children in
+    // one call, and gaps the policy data carried from the parent (the gap
+    // count for the incremental gap heuristic). Nothing is allocated per node.
+    template <typename Heuristic>
+    double search(TopSpinStateSpace::TopSpinState& state, int parentAction,
+                double g, double h, double bound,
+                const Heuristic& heuristic,
+                std::vector<int>& path,
+                std::atomic<bool>& found,
+                topspin::TranspositionTable& table,
+                int gaps = -1,
+                uint32_t context = 0)
+    {
+        if (found) return 0.0;
+        nodesExpanded++;
+        TOPSPIN_PROFILE_COUNT("idastar.generated", 1);
+        double f = g + h;
+
+        if (f > bound) {
+            updateNextBound(bound, f);
+            return h;
+        }
+
+        // Most nodes are cut by the bound above; only the rest touch the table.
+        topspin::TranspositionTable::Key key = tableKey(state);
+        const topspin::TranspositionTable::Entry* entry;
+        {
+            TOPSPIN_PROFILE_SCOPE("idastar.nodeTable");
+            entry = table.find(key);
+        }
+        // A backed-up h from any earlier visit is still a lower bound.
+        if (entry && entry->h > h) {
+            h = entry->h;
+            if (g + h > bound) {
+                updateNextBound(bound, g + h);
+                return h;
+            }
+        }
+
+        if (stateSpace.is_Goal(state)) {
+            // Only the first thread to reach a goal keeps its path.
+            solvedHere = !found.exchange(true);
+            return 0.0;
+        }
+
+        if (cutDuplicates && entry && table.reachedWithin(*entry, g)) {
+            TOPSPIN_PROFILE_COUNT("idastar.duplicates", 1);
+            return h;
+        }
+        double storedH = h;
+        {
+            TOPSPIN_PROFILE_SCOPE("idastar.nodeTable");
+            table.store(key, static_cast<int>(g), static_cast<int>(h));
+        }
+
+        size_t depth = path.size();
+        scoreSuccessors(state, heuristic, depth, parentAction);
+        for (const TopSpinStateSpace::TopSpinAction& action : stateSpace.actions) {
+            if (action.rotate == parentAction) continue;
+            if (pruning && !pruning->allowed(context, action.rotate)) continue;
+            uint32_t childContext = pruning ? pruning->next(context, action.rotate) : 0;
+            double edgeCost = static_cast<double>(action.cost());
+            int childGaps = heuristic.childData(stateSpace, state, gaps, action);
+
+            TopSpinStateSpace::AppliedAction applied = stateSpace.applyInPlace(state, action, canonical);
+            path.push_back(action.rotate);
+            double backedUp = search(state, applied.inverse, g + edgeCost, childH(state, heuristic, depth, action.rotate, childGaps),
+                                     bound, heuristic, path, found, table, childGaps, childContext);
+            // On success the path and the goal state are left as they are.
+            if (found) return 0.0;
+            path.pop_back();
+            stateSpace.undo(state, applied);
+
+            if (backedUp - edgeCost > h) {
+                h = backedUp - edgeCost;
+                if (g + h > bound) {
+                    updateNextBound(bound, g + h);
+                    break;
+                }
+            }
+        }
+        // Keeps the raised h for later visits and iterations.
+        if (h > storedH) table.store(key, static_cast<int>(g), static_cast<int>(h));
+        return h;
+    }
+
+    void updateNextBound(double currBound, double fCost) {
+        lowerNextBound(nextBound, currBound, fCost);
+    }
+
+    static void lowerNextBound(double& next, double currBound, double fCost) {
+        fCost = std::floor(fCost);
+        if (next <= currBound)
+            next = fCost;
+        else if (fCost > currBound && fCost < next)
+            next = fCost;
+    }
+
+    // A subtree root below the frontier, with everything search() needs to
+    // continue from it.
+    struct Task {
+        TopSpinStateSpace::TopSpinState state;
+        int parentAction;
+        double g;
+        double h;
+        int gaps;
+        uint32_t context;
+        std::vector<int> path;
+    };
+
+    struct TaskDeque {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    // Completion of the tasks of one iteration, kept for checkpoints. A
+    // worker publishes its next bound and expansion count after every task;
+    // both only cover work that is finished, or at least valid for it.
+    struct Progress {
+        std::mutex lock;
+        std::vector<char> done;
+        double nextBound = 0.0;
+        long long baseExpanded = 0;
+        std::vector<long long> expanded;
+        std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+    };
+
+    // Tasks of the checkpointed iteration still to be searched, set by
+    // restoreCheckpoint() and used by the next call of searchParallel().
+    bool resumeIteration = false;
+    std::vector<Task> resumeTasks;
+    double resumeNextBound = 0.0;
+
+    std::string heuristicName;
+
+    topspin::CheckpointHeader checkpointHeader() const {
+        topspin::CheckpointHeader header{};
+        header.kind = static_cast<uint8_t>(topspin::CheckpointKind::IDAStar);
+        header.n = static_cast<uint8_t>(stateSpace.n);
+        header.k = stateSpace.initialState.k;
+        header.canonical = canonical;
+        header.pruneLength = static_cast<uint8_t>(pruning ? pruneLength : 0);
+        return header;
+    }
+
+    bool writeCheckpoint(double bound, const std::vector<Task>& tasks, const Progress& progress) const {
+        topspin::CheckpointHeader header = checkpointHeader();
+        header.expanded = static_cast<uint64_t>(progress.baseExpanded);
+        for (long long count : progress.expanded) header.expanded += static_cast<uint64_t>(count);
+        header.nodes = static_cast<uint64_t>(std::count(progress.done.begin(), progress.done.end(), 0));
+        header.bound = bound;
+        header.nextBound = progress.nextBound;
+        topspin::CheckpointWriter out;
+        if (!out.open(checkpointPath, header, heuristicName, stateSpace.initialState)) return false;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            if (progress.done[i]) continue;
+            const Task& task = tasks[i];
+            out.putState(task.state);
+            out.put(static_cast<int32_t>(task.parentAction));
+            out.put(task.g);
+            out.put(task.h);
+            out.put(static_cast<int32_t>(task.gaps));
+            out.put(task.context);
+            out.put(static_cast<uint32_t>(task.path.size()));
+            for (int action : task.path) out.put(static_cast<int32_t>(action));
+        }
+        return out.commit();
+    }
+
+    // Loads the unfinished iteration from checkpointPath and returns its
+    // bound, or a negative value if the checkpoint belongs to another search.
+    double restoreCheckpoint() {
+        topspin::CheckpointReader in;
+        if (!in.open(checkpointPath)) return -1.0;
+        const topspin::CheckpointHeader& header = in.header();
+        topspin::CheckpointHeader expected = checkpointHeader();
+        if (header.kind != expected.kind || header.n != expected.n || header.k != expected.k ||
+            header.canonical != expected.canonical || header.pruneLength != expected.pruneLength ||
+            in.heuristic() != heuristicName || !(in.initialState() == stateSpace.initialState))
+            return -1.0;
+
+        resumeTasks.clear();
+        for (uint64_t i = 0; i < header.nodes; i++) {
+            Task task{stateSpace.initialState, -1, 0.0, 0.0, -1, 0, {}};
+            int32_t parentAction, gaps;
+            uint32_t length;
+            if (!in.getState(task.state) || !in.get(parentAction) || !in.get(task.g) || !in.get(task.h) ||
+                !in.get(gaps) || !in.get(task.context) || !in.get(length) || length > 1u << 16)
+                return -1.0;
+            task.parentAction = parentAction;
+            task.gaps = gaps;
+            task.path.resize(length);
+            for (uint32_t j = 0; j < length; j++) {
+                int32_t action;
+                if (!in.get(action)) return -1.0;
+                task.path[j] = action;
+            }
+            resumeTasks.push_back(std::move(task));
+        }
+        nodesExpanded = static_cast<long long>(header.expanded);
+        resumeNextBound = header.nextBound;
+        resumeIteration = true;
+        return header.bound;
+    }
+
+    // Set on the thread whose search reached the goal first.
+    bool solvedHere = false;
+    long long tasksSearched = 0;
+    long long tasksStolen = 0;
+
+    // Expands the tree down to depth with the same tests as search() and
+    // collects the nodes at that depth as tasks.
+    template <typename Heuristic>
+    void collectFrontier(TopSpinStateSpace::TopSpinState& state, int parentAction,
+                         double g, double h, double bound, int depth,
+                         const Heuristic& heuristic,
+                         std::vector<int>& path,
+                         std::atomic<bool>& found,
+                         std::unordered_map<TopSpinStateSpace::TopSpinState, double>& nodeTable,
+                         int gaps, uint32_t context,
+                         std::vector<Task>& tasks)
+    {
+        if (found) return;
+        if (depth == 0) {
+            tasks.push_back({state, parentAction, g, h, gaps, context, path});
+            return;
+        }
+
+        nodesExpanded++;
+        if (g + h > bound) {
+            updateNextBound(bound, g + h);
+            return;
+        }
+        if (stateSpace.is_Goal(state)) {
+            solvedHere = !found.exchange(true);
+            return;
+        }
+        auto it = nodeTable.find(state);
+        if (it != nodeTable.end() && it->second <= g) return;
+        nodeTable[state] = g;
+
+        size_t pathDepth = path.size();
+        scoreSuccessors(state, heuristic, pathDepth, parentAction);
+        for (const TopSpinStateSpace::TopSpinAction& action : stateSpace.actions) {
+            if (action.rotate == parentAction) continue;
+            if (pruning && !pruning->allowed(context, action.rotate)) continue;
+            uint32_t childContext = pruning ? pruning->next(context, action.rotate) : 0;
+            int childGaps = heuristic.childData(stateSpace, state, gaps, action);
+
+            TopSpinStateSpace::AppliedAction applied = stateSpace.applyInPlace(state, action, canonical);
+            path.push_back(action.rotate);
+            collectFrontier(state, applied.inverse, g + action.cost(), childH(state, heuristic, pathDepth, action.rotate, childGaps),
+                            bound, depth - 1, heuristic, path, found, nodeTable, childGaps, childContext, tasks);
+            if (found) return;
+            path.pop_back();
+            stateSpace.undo(state, applied);
+        }
+    }
+
+    // One bounded iteration on numThreads threads. Each thread searches tasks
+    // from its own deque and steals from the others when it runs dry; the next
+    // bound is the smallest one reported by any thread.
+    template <typename Heuristic>
+    void searchParallel(const TopSpinStateSpace::TopSpinState& initial, double initialH, double bound,
+                        const Heuristic& heuristic,
+                        std::vector<int>& path,
+                        std::atomic<bool>& found,
+                        std::vector<std::unique_ptr<topspin::TranspositionTable>>& tables)
+    {
+        std::vector<Task> tasks;
+        solvedHere = false;
+        if (resumeIteration) {
+            tasks = std::move(resumeTasks);
+            nextBound = resumeNextBound;
+            resumeIteration = false;
+        } else {
+            std::unordered_map<TopSpinStateSpace::TopSpinState, double> frontierTable;
+            int initialGaps = heuristic.data(stateSpace, initial);
+            uint32_t initialContext = pruning ? pruning->rootContext() : 0;
+            TopSpinStateSpace::TopSpinState root = initial;
+            collectFrontier(root, -1, 0.0, initialH, bound, frontierDepth, heuristic, path, found,
+                            frontierTable, initialGaps, initialContext, tasks);
+            if (found) return;
+        }
+
+        // Deques hold task indices; tasks stays complete for checkpoints.
+        std::vector<TaskDeque> deques(numThreads);
+        for (size_t i = 0; i < tasks.size(); i++) {
+            deques[i % numThreads].tasks.push_back(i);
+        }
+
+        Progress progress;
+        progress.done.assign(tasks.size(), 0);
+        progress.nextBound = nextBound;
+        progress.baseExpanded = nodesExpanded;
+        progress.expanded.assign(numThreads, 0);
+
+        std::vector<std::unique_ptr<IDAStarSearch>> workers;
+        for (int t = 0; t < numThreads; t++) {
+            workers.push_back(std::make_unique<IDAStarSearch>(*this));
+            workers.back()->nodesExpanded = 0;
+            workers.back()->nextBound = 0.0;
+            workers.back()->cutDuplicates = !pruning;
+        }
+
+        auto takeTask = [&](int self, size_t& task) {
+            for (int i = 0; i < numThreads; i++) {
+                TaskDeque& source = deques[(self + i) % numThreads];
+                std::lock_guard<std::mutex> guard(source.lock);
+                if (source.tasks.empty()) continue;
+                if (i == 0) {
+                    task = source.tasks.back();
+                    source.tasks.pop_back();
+                } else {
+                    task = source.tasks.front();
+                    source.tasks.pop_front();
+                    workers[self]->tasksStolen++;
+                }
+                return true;
+            }
+            return false;
+        };
+
+        // Marks a task finished and writes a checkpoint when one is due.
+        auto finishTask = [&](int self, size_t index) {
+            IDAStarSearch& worker = *workers[self];
+            std::lock_guard<std::mutex> guard(progress.lock);
+            progress.done[index] = 1;
+            progress.expanded[self] = worker.nodesExpanded;
+            if (worker.nextBound > bound) lowerNextBound(progress.nextBound, bound, worker.nextBound);
+            if (checkpointPath.empty()) return;
+            auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration<double>(now - progress.lastCheckpoint).count() < checkpointInterval) return;
+            TOPSPIN_PROFILE_SCOPE("idastar.checkpoint");
+            if (!writeCheckpoint(bound, tasks, progress)) std::cerr << "Could not write checkpoint\n";
+            progress.lastCheckpoint = now;
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&, t] {
+                IDAStarSearch& worker = *workers[t];
+                topspin::TranspositionTable& table = *tables[t];
+                table.nextIteration();
+                size_t index;
+                while (!found && takeTask(t, index)) {
+                    worker.tasksSearched++;
+                    Task task = tasks[index];
+                    worker.search(task.state, task.parentAction, task.g, task.h, bound, heuristic, task.path,
+                                  found, table, task.gaps, task.context);
+                    if (worker.solvedHere) {
+                        path = std::move(task.path);
+                        return;
+                    }
+                    if (!found) finishTask(t, index);
+                }
+            });
+        }
+        for (std::thread& t : threads) t.join();
+
+        for (int t = 0; t < numThreads; t++) {
+            const IDAStarSearch& worker = *workers[t];
+            nodesExpanded += worker.nodesExpanded;
+            if (worker.nextBound > bound) updateNextBound(bound, worker.nextBound);
+            threadStats[t].nodesExpanded += worker.nodesExpanded;
+            threadStats[t].tasksSearched += worker.tasksSearched;
+            threadStats[t].tasksStolen += worker.tasksStolen;
+        }
+    }
+
+    struct ThreadStats {
+        long long nodesExpanded = 0;
+        long long tasksSearched = 0;
+        long long tasksStolen = 0;
+    };
+    std::vector<ThreadStats> threadStats;
+
+    // Set by run_Algorithm when a goal was reached.
+    bool solved = false;
+
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> run_Algorithm(const std::string& heuristic) {
+        heuristicName = heuristic;
+        return TopSpinStateSpace::withHeuristic(heuristic, [&](const auto& policy) {
+            return run_Algorithm(policy);
+        });
+    }
+
+    template <typename Heuristic>
+    std::vector<TopSpinStateSpace::TopSpinActionStatePair> run_Algorithm(const Heuristic& heuristic) {
+        solved = false;
+        TopSpinStateSpace::TopSpinState initial = stateSpace.getInitialState();
+        if (canonical) stateSpace.canonicalize(initial);
+        double initialH = static_cast<double>(heuristic.value(stateSpace, initial, heuristic.data(stateSpace, initial)));
+        double bound = initialH;
+        nextBound = bound;
+
+        if (bound == static_cast<double>(INT_MAX)) {
+            return {};
+        }
+        if (resume) {
+            bound = restoreCheckpoint();
+            if (bound < 0.0) {
+                std::cerr << "Could not resume from checkpoint " << checkpointPath << "\n";
+                return {};
+            }
+        }
+
+        // Reused by every iteration, so it only grows while the bound does.
+        std::vector<int> path;
+
+        int iteration = 0;
+        std::atomic<bool> found = false;
+        threadStats.assign(numThreads, ThreadStats());
+        std::vector<std::unique_ptr<topspin::TranspositionTable>> tables;
+        for (int t = 0; t < numThreads; t++)
+            tables.push_back(std::make_unique<topspin::TranspositionTable>(tableBytes / numThreads));
+        auto countEntries = [&] {
+            tableEntries = 0;
+            for (const auto& table : tables) tableEntries += table->stored();
+        };
+        while (!found) {
+            path.clear();
+            nextBound = 0.0;
+            if (numThreads > 1 || !checkpointPath.empty()) {
+                searchParallel(initial, initialH, bound, heuristic, path, found, tables);
+            } else {
+                int initialGaps = heuristic.data(stateSpace, initial);
+                uint32_t initialContext = pruning ? pruning->rootContext() : 0;
+                tables[0]->nextIteration();
+                TopSpinStateSpace::TopSpinState root = initial;
+                search(root, -1, 0.0, initialH, bound, heuristic, path, found, *tables[0], initialGaps, initialContext);
+            }
+            countEntries();
+            TOPSPIN_PROFILE_SAMPLE("idastar.expandedByBound", bound, nodesExpanded);
+            TOPSPIN_PROFILE_SAMPLE("idastar.nodeTableSize", bound, tableEntries);
+            iteration++;
+            if (found) {
+                solved = true;
+                return stateSpace.replay(path, canonical);
+            }
+            if (nextBound == 0.0 || nextBound == bound) {
+                return {};
+            }
+            bound = nextBound;
+        }
+        return {};
+    }
+
+    void runSearchAlgorithm(const std::string& heuristic) {
+        using namespace std::chrono;
+
+        TopSpinStateSpace::TopSpinState initial = stateSpace.getInitialState();
+        if (stateSpace.h(initial, heuristic) == INT_MAX) {
+            std::cout << "No solution found!" << std::endl;
+            return;
+        }
+
+        auto timeStart = high_resolution_clock::now();
+        std::vector<TopSpinStateSpace::TopSpinActionStatePair> solution = run_Algorithm(heuristic);
+        if (!solved) {
+            std::cout << "No solution found" << std::endl;
+            return;
+        }
+
+        auto timeEnd = high_resolution_clock::now();
+        double elapsedSeconds = duration<double>(timeEnd - timeStart).count();
+        std::cout << "Initial State: " << initial << "| h = " << stateSpace.h(initial, heuristic) << std::endl;
+        std::cout << elapsedSeconds << " seconds search time" << std::endl;
+        if (numThreads > 1) {
+            std::cout << "Frontier depth: " << frontierDepth << std::endl;
+            for (int t = 0; t < numThreads; t++) {
+                std::cout << "Thread " << t << ": expanded " << threadStats[t].nodesExpanded
+                     << ", subtrees " << threadStats[t].tasksSearched
+                     << ", stolen " << threadStats[t].tasksStolen << std::endl;
+            }
+        }
+        std::cout << "Nodes expanded: " << nodesExpanded << std::endl;
+        std::cout << "Transposition table: " << tableEntries << " entries in "
+                  << (tableBytes >> 20) << " MiB" << std::endl;
+
+        if (solution.empty()) {
+            std::cout << "No solution" << std::endl;
+        } else {
+            int totalCost = 0;
+            for (const auto& pair : solution) {
+                totalCost += pair.action.cost();
+            }
+            std::cout << "Solution length: " << solution.size() << std::endl;
+            std::cout << "Total cost: " << totalCost << std::endl;
+            topspin::printAbstractionCacheStats();
+            std::cout << "-----------------------------------------" << std::endl;
+        }
+    }
+};
+
+#endif
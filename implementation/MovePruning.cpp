@@ -0,0 +1,108 @@
+#include "MovePruning.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <unordered_set>
+#include <cstdint>
+
+namespace topspin {
+
+static constexpr uint64_t MAX_SEQUENCES = 1ull << 22;
+
+static uint64_t power(uint64_t base, int exponent) {
+    uint64_t result = 1;
+    for (int i = 0; i < exponent; i++) result *= base;
+    return result;
+}
+
+MovePruning::MovePruning(int n, int k, int length) : n(n), k(k) {
+    length = std::clamp(length, 1, MAX_LENGTH);
+    while (length > 1 && power(n, length) > MAX_SEQUENCES) length--;
+    this->length = length;
+
+    contexts = static_cast<uint32_t>(power(n + 1, length - 1));
+    root = 0;
+    for (int i = 0; i < length - 1; i++) root = root * (n + 1) + n;
+
+    // redundantOf[len][code]: the sequence of len actions, first action most
+    // significant, has the same effect as a length-lexicographically smaller one.
+    std::vector<std::vector<bool>> redundantOf(length + 1);
+    std::unordered_set<std::string> effects;
+    std::string effect(n, 0);
+    std::vector<int> sequence;
+    for (int len = 0; len <= length; len++) {
+        uint64_t count = power(n, len);
+        redundantOf[len].assign(count, false);
+        sequence.assign(len, 0);
+        for (uint64_t code = 0; code < count; code++) {
+            uint64_t rest = code;
+            for (int i = len - 1; i >= 0; i--) {
+                sequence[i] = static_cast<int>(rest % n);
+                rest /= n;
+            }
+            std::iota(effect.begin(), effect.end(), 0);
+            for (int action : sequence) {
+                for (int i = 0; i < k / 2; i++) {
+                    std::swap(effect[(action + i) % n], effect[(action + k - 1 - i) % n]);
+                }
+            }
+            if (!effects.insert(effect).second) {
+                redundantOf[len][code] = true;
+                redundant++;
+            }
+        }
+    }
+
+    // An action is pruned if it ends a redundant suffix of the history. Longer
+    // redundant sequences contain no redundant prefix that was allowed earlier,
+    // so checking the suffixes ending in the new action is enough.
+    pruned.assign(static_cast<size_t>(contexts) * n, false);
+    std::vector<int> history(length - 1);
+    for (uint32_t context = 0; context < contexts; context++) {
+        uint32_t rest = context;
+        for (int i = 0; i < length - 1; i++) {
+            history[i] = static_cast<int>(rest % (n + 1));   // history[0] is the most recent action
+            rest /= n + 1;
+        }
+        for (int action = 0; action < n; action++) {
+            uint64_t code = action;
+            uint64_t scale = n;
+            bool prune = redundantOf[1][code];
+            for (int len = 2; len <= length && !prune; len++) {
+                int previous = history[len - 2];
+                if (previous == n) break;
+                code += static_cast<uint64_t>(previous) * scale;
+                scale *= n;
+                prune = redundantOf[len][code];
+            }
+            pruned[static_cast<size_t>(context) * n + action] = prune;
+        }
+    }
+}
+
+uint32_t MovePruning::next(uint32_t context, int action) const {
+    if (length == 1) return 0;
+    return static_cast<uint32_t>((static_cast<uint64_t>(context) * (n + 1) + action) % contexts);
+}
+
+double MovePruning::prunedFraction() const {
+    uint64_t total = 0;
+    uint64_t prunedCount = 0;
+    for (uint32_t context = 0; context < contexts; context++) {
+        uint32_t rest = context;
+        bool full = true;
+        for (int i = 0; i < length - 1; i++) {
+            if (rest % (n + 1) == static_cast<uint32_t>(n)) full = false;
+            rest /= n + 1;
+        }
+        if (!full) continue;
+        for (int action = 0; action < n; action++) {
+            total++;
+            prunedCount += pruned[static_cast<size_t>(context) * n + action];
+        }
+    }
+    return total == 0 ? 0.0 : static_cast<double>(prunedCount) / total;
+}
+
+} // namespace topspin
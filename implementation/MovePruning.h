@@ -0,0 +1,50 @@
+#ifndef TOPSPIN_MOVE_PRUNING_H
+#define TOPSPIN_MOVE_PRUNING_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace topspin {
+
+// Move pruning for TopSpin. Every reversal permutes positions independently of
+// the tokens, so two operator sequences with the same position permutation
+// reach the same state from everywhere. All sequences of up to `length`
+// actions are enumerated in length-lexicographic order, and a sequence is
+// redundant if an earlier one has the same effect. The search never generates
+// an action that would end a redundant sequence, which keeps the
+// length-lexicographically smallest of every set of equivalent paths.
+//
+// The history the table needs is the last length - 1 actions, encoded as a
+// context: base-(n + 1) digits, most recent action lowest, n for "none".
+class MovePruning {
+public:
+    static constexpr int MAX_LENGTH = 4;
+
+    // Builds the table for (n, k). length is clamped to [1, MAX_LENGTH] and
+    // lowered further while n^length sequences would exceed a few million.
+    MovePruning(int n, int k, int length = 2);
+
+    uint32_t rootContext() const { return root; }
+    bool allowed(uint32_t context, int action) const { return !pruned[static_cast<size_t>(context) * n + action]; }
+    // Context after applying action in context.
+    uint32_t next(uint32_t context, int action) const;
+
+    int getLength() const { return length; }
+    uint64_t redundantSequences() const { return redundant; }
+    // Fraction of actions pruned after a full history of length - 1 actions.
+    double prunedFraction() const;
+
+private:
+    int n;
+    int k;
+    int length;
+    uint32_t contexts;    // (n + 1)^(length - 1)
+    uint32_t root;
+    uint64_t redundant = 0;
+    std::vector<bool> pruned;
+};
+
+} // namespace topspin
+
+#endif // TOPSPIN_MOVE_PRUNING_H
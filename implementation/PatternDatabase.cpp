@@ -0,0 +1,470 @@
+#include "PatternDatabase.h"
+#include "Profiling.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <fstream>
+#include <iostream>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace topspin {
+
+static constexpr int MAX_TOKENS = 64;
+
+static uint64_t maxEntries = 1ull << 25;
+
+void setPatternDatabaseLimit(uint64_t entries) {
+    maxEntries = std::min<uint64_t>(entries, UINT32_MAX);
+}
+
+static uint64_t saturatingMultiply(uint64_t a, uint64_t b) {
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return product > UINT64_MAX ? UINT64_MAX : static_cast<uint64_t>(product);
+}
+
+uint64_t PatternDatabase::tableSize(int n, const std::function<bool(const uint8_t&)>& predicate) {
+    int m = 0;
+    for (int t = 1; t <= n; t++) {
+        if (predicate(static_cast<uint8_t>(t))) m++;
+    }
+    if (m == 0 || n > MAX_TOKENS) return UINT64_MAX;
+
+    uint64_t size = 1;
+    for (int j = 1; j < m; j++) size = saturatingMultiply(size, n - j);
+    return size;
+}
+
+uint64_t PatternDatabase::tableSizeC(int n, const std::function<int(uint8_t)>& mapping) {
+    if (n > MAX_TOKENS) return UINT64_MAX;
+    std::map<int, int> counts;
+    for (int t = 1; t <= n; t++) counts[mapping(static_cast<uint8_t>(t))]++;
+
+    uint64_t size = 1;
+    int remaining = n;
+    for (const auto& [label, count] : counts) {
+        uint64_t binomial = 1;
+        for (int j = 0; j < count; j++) binomial = binomial * (remaining - j) / (j + 1);
+        size = saturatingMultiply(size, binomial);
+        remaining -= count;
+    }
+    return size;
+}
+
+uint64_t PatternDatabase::rankPositions(const uint8_t* positions) const {
+    const int m = static_cast<int>(tokens.size());
+    uint64_t rank = 0;
+    uint64_t used = 0;
+    for (int j = 1; j < m; j++) {
+        int slot = positions[j] - 1;
+        int index = slot - __builtin_popcountll(used & ((1ull << slot) - 1));
+        rank = rank * (n - j) + index;
+        used |= 1ull << slot;
+    }
+    return rank;
+}
+
+void PatternDatabase::unrankPositions(uint64_t rank, uint8_t* positions) const {
+    const int m = static_cast<int>(tokens.size());
+    uint8_t digits[MAX_TOKENS];
+    for (int j = m - 1; j >= 1; j--) {
+        digits[j] = static_cast<uint8_t>(rank % (n - j));
+        rank /= (n - j);
+    }
+    positions[0] = 0;
+    uint64_t used = 0;
+    for (int j = 1; j < m; j++) {
+        int slot = 0;
+        for (int skip = digits[j]; ; slot++) {
+            if (used & (1ull << slot)) continue;
+            if (skip-- == 0) break;
+        }
+        positions[j] = static_cast<uint8_t>(slot + 1);
+        used |= 1ull << slot;
+    }
+}
+
+uint64_t PatternDatabase::rankLabels(const uint8_t* labels) const {
+    uint8_t count[MAX_TOKENS];
+    std::copy(labelCount.begin(), labelCount.end(), count);
+
+    uint64_t rank = 0;
+    uint64_t total = entries;
+    for (int i = 0, remaining = n; i < n; i++, remaining--) {
+        int label = labels[i];
+        for (int s = 0; s < label; s++) rank += total * count[s] / remaining;
+        total = total * count[label] / remaining;
+        count[label]--;
+    }
+    return rank;
+}
+
+void PatternDatabase::unrankLabels(uint64_t rank, uint8_t* labels) const {
+    uint8_t count[MAX_TOKENS];
+    std::copy(labelCount.begin(), labelCount.end(), count);
+
+    uint64_t total = entries;
+    for (int i = 0, remaining = n; i < n; i++, remaining--) {
+        int label = 0;
+        for (;; label++) {
+            uint64_t block = total * count[label] / remaining;
+            if (rank < block) {
+                total = block;
+                break;
+            }
+            rank -= block;
+        }
+        labels[i] = static_cast<uint8_t>(label);
+        count[label]--;
+    }
+}
+
+void PatternDatabase::buildPositions() {
+    const int m = static_cast<int>(tokens.size());
+    uint8_t current[MAX_TOKENS];
+    uint8_t child[MAX_TOKENS];
+    uint32_t children[MAX_TOKENS];
+
+    for (int j = 0; j < m; j++) current[j] = tokens[j] - tokens[0];
+    std::vector<uint32_t> layer{static_cast<uint32_t>(rankPositions(current))};
+    std::vector<uint32_t> next;
+    setEntry(layer[0], 0);
+
+    for (int depth = 0; !layer.empty(); depth++) {
+        uint8_t value = static_cast<uint8_t>(std::min(depth + 1, static_cast<int>(MAX_DISTANCE)));
+        next.clear();
+        for (uint32_t rank : layer) {
+            unrankPositions(rank, current);
+            int numChildren = 0;
+            for (int pos = 0; pos < n; pos++) {
+                // A token at window offset o moves to offset k - 1 - o.
+                bool moved = false;
+                for (int j = 0; j < m; j++) {
+                    int offset = current[j] - pos;
+                    if (offset < 0) offset += n;
+                    if (offset < k) {
+                        int target = pos + k - 1 - offset;
+                        child[j] = static_cast<uint8_t>(target >= n ? target - n : target);
+                        moved = true;
+                    } else {
+                        child[j] = current[j];
+                    }
+                }
+                if (!moved) continue;
+
+                int shift = child[0];
+                for (int j = 0; j < m; j++) {
+                    int position = child[j] - shift;
+                    child[j] = static_cast<uint8_t>(position < 0 ? position + n : position);
+                }
+                children[numChildren] = static_cast<uint32_t>(rankPositions(child));
+                __builtin_prefetch(&table[children[numChildren] >> 1]);
+                numChildren++;
+            }
+
+            // The table probes are random accesses; ranking all children
+            // first lets their cache misses overlap.
+            for (int c = 0; c < numChildren; c++) {
+                if (entry(children[c]) != UNKNOWN) continue;
+                setEntry(children[c], value);
+                next.push_back(children[c]);
+            }
+        }
+        layer.swap(next);
+    }
+}
+
+void PatternDatabase::buildLabels() {
+    uint8_t current[MAX_TOKENS];
+    uint8_t child[MAX_TOKENS];
+
+    std::vector<uint32_t> layer;
+    std::vector<uint32_t> next;
+    for (int rot = 0; rot < n; rot++) {
+        for (int i = 0; i < n; i++) current[i] = pattern[(i + rot) % n];
+        uint32_t rank = static_cast<uint32_t>(rankLabels(current));
+        if (entry(rank) != UNKNOWN) continue;
+        setEntry(rank, 0);
+        layer.push_back(rank);
+    }
+
+    for (int depth = 0; !layer.empty(); depth++) {
+        uint8_t value = static_cast<uint8_t>(std::min(depth + 1, static_cast<int>(MAX_DISTANCE)));
+        next.clear();
+        for (uint32_t rank : layer) {
+            unrankLabels(rank, current);
+            for (int pos = 0; pos < n; pos++) {
+                std::copy(current, current + n, child);
+                for (int i = 0; i < k / 2; i++) {
+                    std::swap(child[(pos + i) % n], child[(pos + k - 1 - i) % n]);
+                }
+                uint32_t childRank = static_cast<uint32_t>(rankLabels(child));
+                if (entry(childRank) != UNKNOWN) continue;
+                setEntry(childRank, value);
+                next.push_back(childRank);
+            }
+        }
+        layer.swap(next);
+    }
+}
+
+void PatternDatabase::describe(const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate) {
+    this->id = id;
+    this->n = n;
+    this->k = k;
+    pattern.assign(n, 0);
+    slotOf.assign(n + 1, NOT_KEPT);
+    for (int t = 1; t <= n; t++) {
+        if (!predicate(static_cast<uint8_t>(t))) continue;
+        pattern[t - 1] = static_cast<uint8_t>(t);
+        slotOf[t] = static_cast<uint8_t>(tokens.size());
+        tokens.push_back(static_cast<uint8_t>(t));
+    }
+    entries = tableSize(n, predicate);
+}
+
+void PatternDatabase::describeC(const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping) {
+    this->id = id;
+    this->n = n;
+    this->k = k;
+
+    std::vector<int> labels;
+    for (int t = 1; t <= n; t++) labels.push_back(mapping(static_cast<uint8_t>(t)));
+    std::sort(labels.begin(), labels.end());
+    labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+
+    pattern.assign(n, 0);
+    labelOf.assign(n + 1, 0);
+    labelCount.assign(labels.size(), 0);
+    for (int t = 1; t <= n; t++) {
+        int label = static_cast<int>(std::lower_bound(labels.begin(), labels.end(), mapping(static_cast<uint8_t>(t))) - labels.begin());
+        labelOf[t] = static_cast<uint8_t>(label);
+        labelCount[label]++;
+        pattern[t - 1] = static_cast<uint8_t>(label);
+    }
+    entries = tableSizeC(n, mapping);
+}
+
+void PatternDatabase::allocate() {
+    storage.assign((entries + 1) / 2, 0xFF);
+    table = storage.data();
+}
+
+void PatternDatabase::setEntry(uint64_t rank, uint8_t value) {
+    uint8_t& byte = storage[rank >> 1];
+    int shift = (rank & 1) * 4;
+    byte = static_cast<uint8_t>((byte & ~(0xF << shift)) | (value << shift));
+}
+
+std::unique_ptr<PatternDatabase> PatternDatabase::build(const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate) {
+    TOPSPIN_PROFILE_SCOPE("patternDatabase.build");
+    auto pdb = std::make_unique<PatternDatabase>();
+    pdb->describe(id, n, k, predicate);
+    pdb->allocate();
+    pdb->buildPositions();
+    return pdb;
+}
+
+std::unique_ptr<PatternDatabase> PatternDatabase::buildC(const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping) {
+    TOPSPIN_PROFILE_SCOPE("patternDatabase.build");
+    auto pdb = std::make_unique<PatternDatabase>();
+    pdb->describeC(id, n, k, mapping);
+    pdb->allocate();
+    pdb->buildLabels();
+    return pdb;
+}
+
+bool PatternDatabase::map(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    size_t expected = sizeof(PatternDatabaseHeader) + (entries + 1) / 2;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != expected) {
+        close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) return false;
+
+    const auto* header = static_cast<const PatternDatabaseHeader*>(address);
+    RankingScheme ranking = id.compressed ? RankingScheme::MultisetPermutation : RankingScheme::RelativePositions;
+    bool valid = std::memcmp(header->magic, "TSPDB\0\0\0", 8) == 0 &&
+                 header->version == FILE_VERSION &&
+                 header->n == n && header->k == k &&
+                 header->family == static_cast<uint8_t>(id.family) &&
+                 header->compressed == id.compressed &&
+                 header->param == id.param && header->index == id.index &&
+                 header->ranking == static_cast<uint8_t>(ranking) &&
+                 header->entryBits == 4 &&
+                 header->entries == entries &&
+                 std::memcmp(header->pattern, pattern.data(), n) == 0;
+    if (!valid) {
+        munmap(address, expected);
+        return false;
+    }
+    madvise(address, expected, MADV_RANDOM);
+
+    mapped = address;
+    mappedSize = expected;
+    table = static_cast<const uint8_t*>(address) + sizeof(PatternDatabaseHeader);
+    return true;
+}
+
+std::unique_ptr<PatternDatabase> PatternDatabase::load(const std::string& path, const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate) {
+    TOPSPIN_PROFILE_SCOPE("patternDatabase.build");
+    auto pdb = std::make_unique<PatternDatabase>();
+    pdb->describe(id, n, k, predicate);
+    if (pdb->entries == UINT64_MAX || !pdb->map(path)) return nullptr;
+    return pdb;
+}
+
+std::unique_ptr<PatternDatabase> PatternDatabase::loadC(const std::string& path, const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping) {
+    TOPSPIN_PROFILE_SCOPE("patternDatabase.build");
+    auto pdb = std::make_unique<PatternDatabase>();
+    pdb->describeC(id, n, k, mapping);
+    if (pdb->entries == UINT64_MAX || !pdb->map(path)) return nullptr;
+    return pdb;
+}
+
+bool PatternDatabase::save(const std::string& path) const {
+    PatternDatabaseHeader header{};
+    std::memcpy(header.magic, "TSPDB\0\0\0", 8);
+    header.version = FILE_VERSION;
+    header.n = static_cast<uint8_t>(n);
+    header.k = static_cast<uint8_t>(k);
+    header.family = static_cast<uint8_t>(id.family);
+    header.compressed = id.compressed;
+    header.param = id.param;
+    header.index = id.index;
+    header.ranking = static_cast<uint8_t>(id.compressed ? RankingScheme::MultisetPermutation : RankingScheme::RelativePositions);
+    header.entryBits = 4;
+    header.entries = entries;
+    std::copy(pattern.begin(), pattern.end(), header.pattern);
+
+    std::string temporary = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table), static_cast<std::streamsize>((entries + 1) / 2));
+        // Closing flushes the last buffer, which can fail as well.
+        out.close();
+        if (!out) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+PatternDatabase::~PatternDatabase() {
+    if (mapped) munmap(mapped, mappedSize);
+}
+
+int PatternDatabase::lookup(const std::vector<uint8_t>& state) const {
+    uint8_t abstraction[MAX_TOKENS];
+    uint64_t rank;
+    if (id.compressed) {
+        for (int i = 0; i < n; i++) abstraction[i] = labelOf[state[i]];
+        rank = rankLabels(abstraction);
+    } else {
+        for (int i = 0; i < n; i++) {
+            uint8_t slot = slotOf[state[i]];
+            if (slot != NOT_KEPT) abstraction[slot] = static_cast<uint8_t>(i);
+        }
+        const int m = static_cast<int>(tokens.size());
+        int shift = abstraction[0];
+        for (int j = 0; j < m; j++) abstraction[j] = static_cast<uint8_t>((abstraction[j] - shift + n) % n);
+        rank = rankPositions(abstraction);
+    }
+    uint8_t distance = entry(rank);
+    return distance == UNKNOWN ? -1 : distance;
+}
+
+int PatternDatabase::lookupPositions(const uint8_t* positionOf) const {
+    uint8_t abstraction[MAX_TOKENS];
+    const int m = static_cast<int>(tokens.size());
+    int shift = positionOf[tokens[0]];
+    for (int j = 0; j < m; j++) abstraction[j] = static_cast<uint8_t>((positionOf[tokens[j]] - shift + n) % n);
+    uint8_t distance = entry(rankPositions(abstraction));
+    return distance == UNKNOWN ? -1 : distance;
+}
+
+namespace {
+
+struct RegistryKey {
+    AbstractionId id;
+    int n;
+    int k;
+
+    bool operator<(const RegistryKey& other) const {
+        return std::make_tuple(id.family, id.compressed, id.param, id.index, n, k) <
+               std::make_tuple(other.id.family, other.id.compressed, other.id.param, other.id.index, other.n, other.k);
+    }
+};
+
+std::mutex registryMutex;
+std::map<RegistryKey, std::unique_ptr<PatternDatabase>> registry;
+std::string directory = std::getenv("TOPSPIN_PDB_DIR") ? std::getenv("TOPSPIN_PDB_DIR") : "";
+
+std::string fileName(const RegistryKey& key) {
+    std::string name = key.id.family == AbstractionFamily::Group ? "group" : "mod";
+    if (key.id.compressed) name += "C";
+    name += "-" + std::to_string(key.id.param);
+    if (!key.id.compressed) name += "-" + std::to_string(key.id.index);
+    return directory + "/" + name + "-n" + std::to_string(key.n) + "-k" + std::to_string(key.k) + ".pdb";
+}
+
+template<typename SizeFunc, typename Loader, typename Builder>
+const PatternDatabase* lookupOrBuild(const RegistryKey& key, SizeFunc size, Loader load, Builder build) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(key);
+    if (it != registry.end()) return it->second.get();
+
+    std::unique_ptr<PatternDatabase> pdb;
+    if (!directory.empty()) pdb = load(fileName(key));
+    if (!pdb && size() <= maxEntries) {
+        pdb = build();
+        if (!directory.empty() && !pdb->save(fileName(key))) {
+            std::cerr << "Could not write pattern database " << fileName(key) << std::endl;
+        }
+    }
+    return registry.emplace(key, std::move(pdb)).first->second.get();
+}
+
+} // namespace
+
+void setPatternDatabaseDirectory(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    directory = dir;
+}
+
+const PatternDatabase* getPatternDatabase(const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate) {
+    return lookupOrBuild({id, n, k},
+        [&] { return PatternDatabase::tableSize(n, predicate); },
+        [&](const std::string& path) { return PatternDatabase::load(path, id, n, k, predicate); },
+        [&] { return PatternDatabase::build(id, n, k, predicate); });
+}
+
+const PatternDatabase* getPatternDatabaseC(const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping) {
+    return lookupOrBuild({id, n, k},
+        [&] { return PatternDatabase::tableSizeC(n, mapping); },
+        [&](const std::string& path) { return PatternDatabase::loadC(path, id, n, k, mapping); },
+        [&] { return PatternDatabase::buildC(id, n, k, mapping); });
+}
+
+} // namespace topspin
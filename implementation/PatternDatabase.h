@@ -0,0 +1,140 @@
+#ifndef TOPSPIN_PATTERN_DATABASE_H
+#define TOPSPIN_PATTERN_DATABASE_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace topspin {
+
+enum class AbstractionFamily : uint8_t { Group, Mod };
+
+// How abstract states are mapped to table indices.
+enum class RankingScheme : uint8_t {
+    RelativePositions = 1,    // padded: positions of the kept tokens relative to the smallest one
+    MultisetPermutation = 2   // compressed: the label sequence as a multiset permutation
+};
+
+// Identifies one abstraction: the family, whether it is padded (tokens outside
+// the pattern become 0) or compressed (tokens are mapped to labels), the family
+// parameter (number of groups / modulus) and, for padded abstractions, which
+// group or residue class is kept.
+struct AbstractionId {
+    AbstractionFamily family;
+    bool compressed;
+    uint8_t param;
+    uint8_t index;
+};
+
+// Layout of a pattern database file: this header followed by the table with
+// two 4-bit entries per byte, low nibble first.
+struct PatternDatabaseHeader {
+    char magic[8];            // "TSPDB\0\0\0"
+    uint32_t version;
+    uint8_t n;
+    uint8_t k;
+    uint8_t family;           // AbstractionFamily
+    uint8_t compressed;
+    uint8_t param;
+    uint8_t index;
+    uint8_t ranking;          // RankingScheme
+    uint8_t entryBits;
+    uint32_t reserved0;
+    uint64_t entries;
+    uint8_t pattern[64];      // abstract goal: the label of every token 1..n
+    uint8_t reserved[32];
+};
+static_assert(sizeof(PatternDatabaseHeader) == 128, "pattern database header must stay 128 bytes");
+
+// Exact abstract distances for every abstract state of one abstraction, built
+// by a single backward BFS from the abstract goal set. Entries are 4 bits wide:
+// distances saturate at MAX_DISTANCE, which keeps them admissible, and UNKNOWN
+// marks abstract states from which the goal cannot be reached.
+class PatternDatabase {
+public:
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr uint8_t MAX_DISTANCE = 14;
+    static constexpr uint8_t UNKNOWN = 15;
+
+    static std::unique_ptr<PatternDatabase> build(const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate);
+    static std::unique_ptr<PatternDatabase> buildC(const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping);
+
+    // Maps a file written by save() read-only. Returns nullptr if the file is
+    // missing or was written for a different abstraction or version.
+    static std::unique_ptr<PatternDatabase> load(const std::string& path, const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate);
+    static std::unique_ptr<PatternDatabase> loadC(const std::string& path, const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping);
+
+    // Writes the table to a temporary file and renames it into place, so
+    // concurrent readers never see a partial file.
+    bool save(const std::string& path) const;
+
+    // Number of entries the table of an abstraction would need, saturated at UINT64_MAX.
+    static uint64_t tableSize(int n, const std::function<bool(const uint8_t&)>& predicate);
+    static uint64_t tableSizeC(int n, const std::function<int(uint8_t)>& mapping);
+
+    PatternDatabase() = default;
+    PatternDatabase(const PatternDatabase&) = delete;
+    PatternDatabase& operator=(const PatternDatabase&) = delete;
+    ~PatternDatabase();
+
+    // Abstract distance of a concrete state, -1 if the abstract goal is unreachable.
+    int lookup(const std::vector<uint8_t>& state) const;
+    // Same for a padded table, given the position of every token (indexed by
+    // token), so several tables can share one pass over the state.
+    int lookupPositions(const uint8_t* positionOf) const;
+    uint64_t size() const { return entries; }
+    bool isMapped() const { return mapped != nullptr; }
+
+private:
+    static constexpr uint8_t NOT_KEPT = 0xFF;
+
+    AbstractionId id{};
+    int n = 0;
+    int k = 0;
+    std::vector<uint8_t> pattern;     // abstract goal, stored in the file header
+    std::vector<uint8_t> tokens;      // padded: kept tokens in increasing order
+    std::vector<uint8_t> slotOf;      // padded: index of a token in tokens, NOT_KEPT otherwise
+    std::vector<uint8_t> labelOf;     // compressed: label of each token, renumbered from 0
+    std::vector<uint8_t> labelCount;  // compressed: number of tokens per label
+
+    uint64_t entries = 0;
+    std::vector<uint8_t> storage;     // packed table when built in this process
+    const uint8_t* table = nullptr;   // storage or the table inside the mapped file
+    void* mapped = nullptr;
+    size_t mappedSize = 0;
+
+    uint8_t entry(uint64_t rank) const { return (table[rank >> 1] >> ((rank & 1) * 4)) & 0xF; }
+    void setEntry(uint64_t rank, uint8_t value);
+
+    uint64_t rankPositions(const uint8_t* positions) const;
+    void unrankPositions(uint64_t rank, uint8_t* positions) const;
+    uint64_t rankLabels(const uint8_t* labels) const;
+    void unrankLabels(uint64_t rank, uint8_t* labels) const;
+
+    void describe(const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate);
+    void describeC(const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping);
+    void allocate();
+    bool map(const std::string& path);
+    void buildPositions();
+    void buildLabels();
+};
+
+// Largest table (in entries) that is built; bigger abstractions fall back to
+// the on-demand search in Abstraction.cpp.
+void setPatternDatabaseLimit(uint64_t maxEntries);
+
+// Directory in which tables are looked up before building them and to which
+// newly built tables are saved. Defaults to $TOPSPIN_PDB_DIR; empty disables files.
+void setPatternDatabaseDirectory(const std::string& directory);
+
+// Shared pattern database of an abstraction for (n, k), loaded or built on
+// first use. Returns nullptr if no file exists and the table would exceed the limit.
+const PatternDatabase* getPatternDatabase(const AbstractionId& id, int n, int k, const std::function<bool(const uint8_t&)>& predicate);
+const PatternDatabase* getPatternDatabaseC(const AbstractionId& id, int n, int k, const std::function<int(uint8_t)>& mapping);
+
+} // namespace topspin
+
+#endif // TOPSPIN_PATTERN_DATABASE_H
@@ -0,0 +1,155 @@
+#include "Profiling.h"
+
+#ifdef TOPSPIN_PROFILE
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+namespace topspin::profile {
+
+namespace {
+
+// Never destroyed, so the report written at exit can still read it. The slot
+// blocks of finished threads stay here for the same reason.
+struct Registry {
+    std::mutex lock;
+    std::vector<std::string> names;
+    std::vector<Kind> kinds;
+    std::vector<Slot*> threads;
+    std::map<std::string, std::vector<std::pair<uint64_t, uint64_t>>> series;
+    bool reportScheduled = false;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+bool endsWith(const std::string& text, const char* suffix) {
+    size_t length = std::strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+void writeReport();
+
+// Called with the lock held.
+void scheduleReport(Registry& r) {
+    if (r.reportScheduled) return;
+    r.reportScheduled = true;
+    std::atexit(writeReport);
+}
+
+void writeReport() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::vector<Slot> totals(r.names.size());
+    for (Slot* slots : r.threads) {
+        for (size_t i = 0; i < totals.size(); i++) {
+            totals[i].count += slots[i].count;
+            totals[i].total += slots[i].total;
+        }
+    }
+    std::map<std::string, Slot> timers;
+    std::map<std::string, uint64_t> counters;
+    for (size_t i = 0; i < totals.size(); i++) {
+        if (r.kinds[i] == Kind::Timer) timers[r.names[i]] = totals[i];
+        else counters[r.names[i]] = totals[i].total;
+    }
+
+    std::map<std::string, double> rates;
+    auto rate = [&](const std::string& prefix, const char* part, const char* whole, const char* name, bool sum) {
+        auto a = counters.find(prefix + part);
+        auto b = counters.find(prefix + whole);
+        if (a == counters.end() || b == counters.end()) return;
+        double denominator = static_cast<double>(b->second) + (sum ? a->second : 0);
+        if (denominator > 0) rates[prefix + name] = a->second / denominator;
+    };
+    for (const auto& [name, value] : counters) {
+        if (endsWith(name, ".hits")) rate(name.substr(0, name.size() - 5), ".hits", ".misses", ".hitRate", true);
+        if (endsWith(name, ".duplicates")) rate(name.substr(0, name.size() - 11), ".duplicates", ".generated", ".duplicateRate", false);
+    }
+
+    const char* configured = std::getenv("TOPSPIN_PROFILE_OUT");
+    std::string path = configured ? configured : "topspin-profile.json";
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Could not write profile " << path << std::endl;
+        return;
+    }
+    out << "{\n  \"timers\": {";
+    const char* separator = "\n";
+    for (const auto& [name, slot] : timers) {
+        out << separator << "    \"" << name << "\": {\"calls\": " << slot.count
+            << ", \"seconds\": " << slot.total * 1e-9 << "}";
+        separator = ",\n";
+    }
+    out << "\n  },\n  \"counters\": {";
+    separator = "\n";
+    for (const auto& [name, value] : counters) {
+        out << separator << "    \"" << name << "\": " << value;
+        separator = ",\n";
+    }
+    out << "\n  },\n  \"rates\": {";
+    separator = "\n";
+    for (const auto& [name, value] : rates) {
+        out << separator << "    \"" << name << "\": " << value;
+        separator = ",\n";
+    }
+    out << "\n  },\n  \"series\": {";
+    separator = "\n";
+    for (const auto& [name, points] : r.series) {
+        out << separator << "    \"" << name << "\": [";
+        for (size_t i = 0; i < points.size(); i++) {
+            out << (i ? ", " : "") << "[" << points[i].first << ", " << points[i].second << "]";
+        }
+        out << "]";
+        separator = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
+
+} // namespace
+
+int slot(const char* name, Kind kind) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    scheduleReport(r);
+    for (size_t i = 0; i < r.names.size(); i++) {
+        if (r.names[i] == name && r.kinds[i] == kind) return static_cast<int>(i);
+    }
+    if (r.names.size() == MAX_SLOTS) {
+        std::cerr << "Too many profiling slots, dropping " << name << std::endl;
+        return MAX_SLOTS - 1;
+    }
+    r.names.push_back(name);
+    r.kinds.push_back(kind);
+    return static_cast<int>(r.names.size() - 1);
+}
+
+Slot* threadSlots() {
+    thread_local Slot* slots = [] {
+        Slot* block = new Slot[MAX_SLOTS];
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.threads.push_back(block);
+        return block;
+    }();
+    return slots;
+}
+
+void sample(const char* name, uint64_t x, uint64_t value) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    scheduleReport(r);
+    r.series[name].emplace_back(x, value);
+}
+
+} // namespace topspin::profile
+
+#endif // TOPSPIN_PROFILE
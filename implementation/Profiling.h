@@ -0,0 +1,85 @@
+#ifndef TOPSPIN_PROFILING_H
+#define TOPSPIN_PROFILING_H
+
+// Scoped timers, counters and sampled series for the hot paths. All of it
+// compiles to nothing unless TOPSPIN_PROFILE is defined. When it is, every
+// thread updates its own slots without locking, and the totals of all threads
+// are written as JSON at exit to $TOPSPIN_PROFILE_OUT, or
+// topspin-profile.json in the working directory.
+//
+//   TOPSPIN_PROFILE_SCOPE("astar.closed");            // time until end of scope
+//   TOPSPIN_PROFILE_COUNT("astar.duplicates", 1);     // add to a counter
+//   TOPSPIN_PROFILE_SAMPLE("astar.openSize", x, y);   // append (x, y) to a series
+//
+// Names must be string literals. Counters named <prefix>.hits and
+// <prefix>.misses also get <prefix>.hitRate in the report, and
+// <prefix>.duplicates with <prefix>.generated get <prefix>.duplicateRate.
+
+#ifdef TOPSPIN_PROFILE
+
+#include <chrono>
+#include <cstdint>
+
+namespace topspin::profile {
+
+enum class Kind : uint8_t { Timer, Counter };
+
+struct Slot {
+    uint64_t count = 0;   // timed calls, or counter updates
+    uint64_t total = 0;   // nanoseconds, or the sum of all deltas
+};
+
+static constexpr int MAX_SLOTS = 256;
+
+// Id of the slot for name, registered on first use.
+int slot(const char* name, Kind kind);
+// This thread's slots, indexed by id.
+Slot* threadSlots();
+void sample(const char* name, uint64_t x, uint64_t value);
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(int id) : id(id), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        Slot& s = threadSlots()[id];
+        s.count++;
+        s.total += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    int id;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace topspin::profile
+
+#define TOPSPIN_PROFILE_JOIN2(a, b) a##b
+#define TOPSPIN_PROFILE_JOIN(a, b) TOPSPIN_PROFILE_JOIN2(a, b)
+
+#define TOPSPIN_PROFILE_SCOPE(name)                                                              \
+    static const int TOPSPIN_PROFILE_JOIN(topspinProfileSlot, __LINE__) =                        \
+        topspin::profile::slot(name, topspin::profile::Kind::Timer);                             \
+    topspin::profile::ScopedTimer TOPSPIN_PROFILE_JOIN(topspinProfileTimer, __LINE__)(           \
+        TOPSPIN_PROFILE_JOIN(topspinProfileSlot, __LINE__))
+
+#define TOPSPIN_PROFILE_COUNT(name, delta)                                                       \
+    do {                                                                                         \
+        static const int topspinProfileSlot = topspin::profile::slot(name, topspin::profile::Kind::Counter); \
+        topspin::profile::Slot& topspinProfileEntry = topspin::profile::threadSlots()[topspinProfileSlot]; \
+        topspinProfileEntry.count++;                                                             \
+        topspinProfileEntry.total += static_cast<uint64_t>(delta);                               \
+    } while (0)
+
+#define TOPSPIN_PROFILE_SAMPLE(name, x, value) \
+    topspin::profile::sample(name, static_cast<uint64_t>(x), static_cast<uint64_t>(value))
+
+#else
+
+#define TOPSPIN_PROFILE_SCOPE(name) ((void)0)
+#define TOPSPIN_PROFILE_COUNT(name, delta) ((void)0)
+#define TOPSPIN_PROFILE_SAMPLE(name, x, value) ((void)0)
+
+#endif // TOPSPIN_PROFILE
+
+#endif // TOPSPIN_PROFILING_H
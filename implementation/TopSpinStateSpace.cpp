@@ -6,21 +6,123 @@
 #include <cstdint>
 #include <cmath>
 #include <climits>
+#include <unordered_map>
 
 TopSpinStateSpace::TopSpinState::TopSpinState() : size(0) {}
 TopSpinStateSpace::TopSpinState::TopSpinState(const std::vector<uint8_t>& perm, const int k) {
-    permutation = perm;
-    size = perm.size();
-    this->k = k;
+    size = static_cast<uint8_t>(perm.size());
+    this->k = static_cast<uint8_t>(k);
+    if (size > PACKED_MAX) {
+        wide = new uint8_t[size];
+    }
+    for (int i = 0; i < size; i++) {
+        setToken(i, perm[i]);
+    }
+}
+
+TopSpinStateSpace::TopSpinState::TopSpinState(const TopSpinState& other)
+    : packed(other.packed), size(other.size), k(other.k) {
+    if (other.wide) {
+        wide = new uint8_t[size];
+        std::copy(other.wide, other.wide + size, wide);
+    }
+}
+
+TopSpinStateSpace::TopSpinState::TopSpinState(TopSpinState&& other) noexcept
+    : packed(other.packed), wide(other.wide), size(other.size), k(other.k) {
+    other.wide = nullptr;
+}
+
+TopSpinStateSpace::TopSpinState& TopSpinStateSpace::TopSpinState::operator=(const TopSpinState& other) {
+    if (this == &other) return *this;
+    if (other.wide) {
+        if (!wide || size != other.size) {
+            delete[] wide;
+            wide = new uint8_t[other.size];
+        }
+        std::copy(other.wide, other.wide + other.size, wide);
+    } else {
+        delete[] wide;
+        wide = nullptr;
+    }
+    packed = other.packed;
+    size = other.size;
+    k = other.k;
+    return *this;
+}
+
+TopSpinStateSpace::TopSpinState& TopSpinStateSpace::TopSpinState::operator=(TopSpinState&& other) noexcept {
+    if (this == &other) return *this;
+    delete[] wide;
+    packed = other.packed;
+    wide = other.wide;
+    size = other.size;
+    k = other.k;
+    other.wide = nullptr;
+    return *this;
+}
+
+TopSpinStateSpace::TopSpinState::~TopSpinState() {
+    delete[] wide;
+}
+
+void TopSpinStateSpace::TopSpinState::setToken(int i, uint8_t value) {
+    if (wide) {
+        wide[i] = value;
+        return;
+    }
+    int shift = TOKEN_BITS * i;
+    packed = (packed & ~(static_cast<Packed>(0x1F) << shift)) | (static_cast<Packed>(value) << shift);
+}
+
+void TopSpinStateSpace::TopSpinState::unpack(std::vector<uint8_t>& out) const {
+    out.resize(size);
+    for (int i = 0; i < size; i++) {
+        out[i] = token(i);
+    }
+}
+
+std::vector<uint8_t> TopSpinStateSpace::TopSpinState::permutation() const {
+    std::vector<uint8_t> out;
+    unpack(out);
+    return out;
+}
+
+void TopSpinStateSpace::TopSpinState::rotate(int first) {
+    if (first == 0) return;
+    if (wide) {
+        std::rotate(wide, wide + first, wide + size);
+        return;
+    }
+    int bits = TOKEN_BITS * size;
+    Packed mask = (static_cast<Packed>(1) << bits) - 1;
+    packed = ((packed >> (TOKEN_BITS * first)) | (packed << (bits - TOKEN_BITS * first))) & mask;
+}
+
+size_t TopSpinStateSpace::TopSpinState::hash() const {
+    if (wide) {
+        size_t h = 0;
+        for (int i = 0; i < size; i++)
+            h ^= std::hash<int>()(wide[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+    uint64_t h = static_cast<uint64_t>(packed) ^ (static_cast<uint64_t>(packed >> 64) * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
 }
 
 bool TopSpinStateSpace::TopSpinState::operator==(const TopSpinState& other) const {
-    return permutation == other.permutation;
+    if (packed != other.packed || size != other.size) return false;
+    return !wide || std::equal(wide, wide + size, other.wide);
 }
 
 std::ostream& operator<<(std::ostream& os, const TopSpinStateSpace::TopSpinState& state) {
-    for (size_t i = 0; i < state.permutation.size(); ++i) {
-        os << static_cast<int>(state.permutation[i]) << " ";
+    for (int i = 0; i < state.size; ++i) {
+        os << static_cast<int>(state.token(i)) << " ";
     }
     return os;
 }
@@ -35,14 +137,30 @@ int TopSpinStateSpace::TopSpinAction::cost() const {
 
 void TopSpinStateSpace::TopSpinAction::apply(TopSpinState& state) const {
     if (rotate < 0) return;
-    int n = static_cast<int>(state.permutation.size());
+    int n = state.size;
     int k = state.k;
 
+    if (state.wide) {
+        for (int i = 0; i < k / 2; i++) {
+            int left = (rotate + i) % n;
+            int right = (rotate + k - 1 - i) % n;
+            std::swap(state.wide[left], state.wide[right]);
+        }
+        return;
+    }
+
+    using Packed = TopSpinState::Packed;
+    const int bits = TopSpinState::TOKEN_BITS;
+    Packed value = state.packed;
     for (int i = 0; i < k / 2; i++) {
-        int left = (rotate + i) % n;
-        int right = (rotate + k - 1 - i) % n;
-        std::swap(state.permutation[left], state.permutation[right]);
+        int left = rotate + i;
+        int right = rotate + k - 1 - i;
+        if (left >= n) left -= n;
+        if (right >= n) right -= n;
+        Packed diff = ((value >> (bits * left)) ^ (value >> (bits * right))) & 0x1F;
+        value ^= (diff << (bits * left)) | (diff << (bits * right));
     }
+    state.packed = value;
 }
 
 std::ostream& operator<<(std::ostream& os, const TopSpinStateSpace::TopSpinAction& action) {
@@ -58,6 +176,9 @@ TopSpinStateSpace::TopSpinStateSpace(int size, TopSpinState initial) {
     n = initial.size;
     for (int i = 0; i < n; i++) {
         actions.push_back(TopSpinAction(i));
+        if (i < TopSpinState::PACKED_MAX) {
+            goal |= static_cast<TopSpinState::Packed>(i + 1) << (TopSpinState::TOKEN_BITS * i);
+        }
     }
 }
 
@@ -66,9 +187,18 @@ TopSpinStateSpace::TopSpinState TopSpinStateSpace::getInitialState() const {
 }
 
 bool TopSpinStateSpace::is_Goal(const TopSpinState& state) const {
+    if (state.isPacked()) {
+        // A goal is a rotation of the identity: rotate token 1 to the front and compare.
+        int first = 0;
+        while (first < n && state.token(first) != 1) first++;
+        if (first == n) return false;
+        TopSpinState rotated = state;
+        rotated.rotate(first);
+        return rotated.packed == goal;
+    }
     for (int i = 0; i < n; i++) {
-        int a = state.permutation[i];
-        int b = state.permutation[(i + 1) % n];
+        int a = state.wide[i];
+        int b = state.wide[(i + 1) % n];
         if (a == n && b != 1) return false;
         if (a != n && a + 1 != b) return false;
     }
@@ -76,6 +206,7 @@ bool TopSpinStateSpace::is_Goal(const TopSpinState& state) const {
 }
 
 std::vector<TopSpinStateSpace::TopSpinActionStatePair> TopSpinStateSpace::successors(const TopSpinState& state) const {
+    TOPSPIN_PROFILE_SCOPE("stateSpace.successors");
     std::vector<TopSpinActionStatePair> result;
     for (const auto& action : actions) {
         TopSpinState newState = state;
@@ -85,9 +216,110 @@ std::vector<TopSpinStateSpace::TopSpinActionStatePair> TopSpinStateSpace::succes
     return result;
 }
 
-int TopSpinStateSpace::h(const TopSpinState& state, const std::string& heuristic) const {
-    using HeuristicFunc = int(*)(const std::vector<uint8_t>&, int);
-    static const std::unordered_map<std::string, HeuristicFunc> heuristics = {
+void TopSpinStateSpace::fillSuccessorBatch(const TopSpinState& state, bool canonical, int skip, bool tokens,
+                                           topspin::SuccessorBatch& batch) const {
+    TOPSPIN_PROFILE_SCOPE("stateSpace.successorBatch");
+    const int k = state.k;
+    state.unpack(batch.parent);
+    batch.n = n;
+    batch.k = k;
+    batch.count = n;
+    batch.skip = skip;
+    batch.offset.assign(n, 0);
+    if (canonical) {
+        for (int s = 0; s < n; s++) batch.offset[s] = static_cast<uint8_t>(canonicalOffset(s, k));
+    }
+    if (!tokens) {
+        batch.tokens.clear();
+        return;
+    }
+
+    // Every row starts as the parent's token for all successors; then each
+    // successor's window is written reversed.
+    batch.tokens.resize(static_cast<size_t>(n) * n);
+    for (int i = 0; i < n; i++) {
+        std::fill_n(batch.tokens.data() + static_cast<size_t>(i) * n, n, batch.parent[i]);
+    }
+    for (int s = 0; s < n; s++) {
+        for (int j = 0; j < k; j++) {
+            batch.tokens[static_cast<size_t>(batch.window(s, j)) * n + s] = batch.parent[batch.source(s, j)];
+        }
+    }
+
+    thread_local std::vector<uint8_t> column;
+    column.resize(n);
+    for (int s = 0; s < n; s++) {
+        int offset = batch.offset[s];
+        if (offset == 0) continue;
+        for (int i = 0; i < n; i++) column[i] = batch.token(s, i + offset < n ? i + offset : i + offset - n);
+        for (int i = 0; i < n; i++) batch.tokens[static_cast<size_t>(i) * n + s] = column[i];
+    }
+}
+
+static int positionOfOne(const TopSpinStateSpace::TopSpinState& state) {
+    for (int i = 0; i < state.size; i++) {
+        if (state.token(i) == 1) return i;
+    }
+    return 0;
+}
+
+void TopSpinStateSpace::canonicalize(TopSpinState& state) const {
+    state.rotate(positionOfOne(state));
+}
+
+std::vector<TopSpinStateSpace::TopSpinActionStatePair> TopSpinStateSpace::restoreRotation(
+    const std::vector<TopSpinActionStatePair>& path) const {
+    std::vector<int> actions;
+    actions.reserve(path.size());
+    for (const auto& pair : path) actions.push_back(pair.action.rotate);
+    return replay(actions, true);
+}
+
+std::vector<TopSpinStateSpace::TopSpinActionStatePair> TopSpinStateSpace::replay(
+    const std::vector<int>& actions, bool canonical) const {
+    std::vector<TopSpinActionStatePair> result;
+    result.reserve(actions.size());
+    TopSpinState state = initialState;
+    for (int rotate : actions) {
+        // The canonical state starts at the position of token 1 in the real one.
+        TopSpinAction action(canonical ? (rotate + positionOfOne(state)) % n : rotate);
+        action.apply(state);
+        result.emplace_back(action, state);
+    }
+    return result;
+}
+
+static bool isGap(int a, int b, int n) {
+    if ((a == n && b == 1) || (a == 1 && b == n)) return false;
+    return std::abs(a - b) > 1;
+}
+
+int TopSpinStateSpace::gaps(const TopSpinState& state) const {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        count += isGap(state.token(i), state.token((i + 1) % n), n);
+    }
+    return count;
+}
+
+int TopSpinStateSpace::gapsAfter(const TopSpinState& state, int stateGaps, const TopSpinAction& action) const {
+    int k = state.k;
+    if (action.rotate < 0 || k >= n) return stateGaps;
+
+    int first = action.rotate;
+    int last = (first + k - 1) % n;
+    int before = state.token((first + n - 1) % n);
+    int after = state.token((last + 1) % n);
+    int a = state.token(first);
+    int b = state.token(last);
+
+    return stateGaps
+        - isGap(before, a, n) - isGap(b, after, n)
+        + isGap(before, b, n) + isGap(a, after, n);
+}
+
+static const std::unordered_map<std::string, TopSpinStateSpace::HeuristicFunc>& heuristicTable() {
+    static const std::unordered_map<std::string, TopSpinStateSpace::HeuristicFunc> heuristics = {
         {"gap", topspin::gapHeuristic},
         {"manhattan", topspin::circularManhattanHeuristic},
         {"twoGroup", [](const std::vector<uint8_t>& s, int k) { return topspin::groupHeuristic(s, k, 2); }},
@@ -105,10 +337,38 @@ int TopSpinStateSpace::h(const TopSpinState& state, const std::string& heuristic
         {"fourDistanceC", [](const std::vector<uint8_t>& s, int k) { return topspin::modDistanceC(s, k, 4); }},
         {"breakpoint", topspin::breakpointHeuristic}
     };
+    return heuristics;
+}
 
+TopSpinStateSpace::HeuristicFunc TopSpinStateSpace::resolveHeuristic(const std::string& heuristic) {
+    const auto& heuristics = heuristicTable();
     auto it = heuristics.find(heuristic);
-    if (it != heuristics.end()) {
-        return it->second(state.permutation, state.k);
-    }
-    return INT_MAX;
+    return it != heuristics.end() ? it->second : nullptr;
+}
+
+topspin::BatchHeuristicFunc TopSpinStateSpace::resolveBatchHeuristic(const std::string& heuristic, bool* readsSuccessors) {
+    struct Batch {
+        topspin::BatchHeuristicFunc function;
+        bool readsSuccessors;
+    };
+    static const std::unordered_map<std::string, Batch> batches = {
+        {"manhattan", {topspin::circularManhattanHeuristicBatch, false}}
+    };
+    auto it = batches.find(heuristic);
+    if (it == batches.end()) return nullptr;
+    if (readsSuccessors) *readsSuccessors = it->second.readsSuccessors;
+    return it->second.function;
+}
+
+std::vector<std::string> TopSpinStateSpace::heuristicNames() {
+    std::vector<std::string> names;
+    for (const auto& entry : heuristicTable()) names.push_back(entry.first);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+int TopSpinStateSpace::h(const TopSpinState& state, const std::string& heuristic) const {
+    return withHeuristic(heuristic, [&](const auto& policy) {
+        return policy.value(*this, state, policy.data(*this, state));
+    });
 }
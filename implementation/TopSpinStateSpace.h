@@ -1,19 +1,50 @@
 #ifndef TOPSPINSTATESPACE_H
 #define TOPSPINSTATESPACE_H
 
+#include "Heuristics.h"
+#include "Profiling.h"
 #include <iostream>
 #include <vector>
+#include <string>
+#include <functional>
 #include <cstdint>
+#include <climits>
 
 class TopSpinStateSpace {
 public:
+    // Tokens are packed TOKEN_BITS bits each into one 128-bit word for puzzles
+    // of up to PACKED_MAX tokens, so copies, comparisons and hashing work on the
+    // word directly. Larger puzzles store one byte per token on the heap.
     class TopSpinState {
     public:
-        std::vector<uint8_t> permutation;
-        int size;
-        int k;
+        using Packed = unsigned __int128;
+        static constexpr int TOKEN_BITS = 5;
+        static constexpr int PACKED_MAX = 25;
+
+        Packed packed = 0;
+        uint8_t* wide = nullptr;
+        uint8_t size = 0;
+        uint8_t k = 0;
+
         TopSpinState();
         TopSpinState(const std::vector<uint8_t>& perm, const int k);
+        TopSpinState(const TopSpinState& other);
+        TopSpinState(TopSpinState&& other) noexcept;
+        TopSpinState& operator=(const TopSpinState& other);
+        TopSpinState& operator=(TopSpinState&& other) noexcept;
+        ~TopSpinState();
+
+        bool isPacked() const { return wide == nullptr; }
+        uint8_t token(int i) const {
+            return isPacked() ? static_cast<uint8_t>((packed >> (TOKEN_BITS * i)) & 0x1F) : wide[i];
+        }
+        void setToken(int i, uint8_t value);
+        void unpack(std::vector<uint8_t>& out) const;
+        std::vector<uint8_t> permutation() const;
+        // Rotates left so that the token at position first moves to position 0.
+        void rotate(int first);
+        size_t hash() const;
+
         bool operator==(const TopSpinState& other) const;
         friend std::ostream& operator<<(std::ostream& os, const TopSpinState& state);
     };
@@ -36,13 +67,182 @@ public:
 
     int n;
     TopSpinState initialState;
+    TopSpinState::Packed goal = 0;
     std::vector<TopSpinAction> actions;
 
     TopSpinStateSpace(int size, TopSpinState initial);
     TopSpinState getInitialState() const;
     bool is_Goal(const TopSpinState& state) const;
     std::vector<TopSpinActionStatePair> successors(const TopSpinState& state) const;
+
+    // Rotates state so that token 1 is at position 0. The goal test and the
+    // move set are invariant under rotation, so searches may work on the
+    // canonical representatives only.
+    void canonicalize(TopSpinState& state) const;
+    // Replays a path found on canonical states from the initial state,
+    // remapping each action to the position it has in the unrotated state.
+    std::vector<TopSpinActionStatePair> restoreRotation(const std::vector<TopSpinActionStatePair>& path) const;
+    // Applies actions, given by position, from the initial state and pairs
+    // each with the state it reaches. Positions of a canonical search are
+    // remapped as in restoreRotation.
+    std::vector<TopSpinActionStatePair> replay(const std::vector<int>& actions, bool canonical) const;
+
+    // An action applied in place by applyInPlace, with what undo needs to get
+    // the state back.
+    struct AppliedAction {
+        int rotate;    // position the action was applied at
+        int offset;    // left rotation that made the result canonical
+        int inverse;   // position of the same reversal in the result
+    };
+
+    // Successor iteration without copies: applies action to state in place,
+    // rotating the result to canonical form if canonical is set (state must
+    // then be canonical already). Every reversal is its own inverse, so undo
+    // restores state exactly; applying inverse to the result leads back to
+    // state as well, which searches use to skip the parent.
+    AppliedAction applyInPlace(TopSpinState& state, const TopSpinAction& action, bool canonical) const {
+        action.apply(state);
+        int offset = canonical ? canonicalOffset(action.rotate, state.k) : 0;
+        state.rotate(offset);
+        return {action.rotate, offset, (action.rotate - offset + n) % n};
+    }
+
+    void undo(TopSpinState& state, const AppliedAction& applied) const {
+        if (applied.offset) state.rotate(n - applied.offset);
+        TopSpinAction(applied.rotate).apply(state);
+    }
+
+    // Position token 1 of a canonical state moves to under the reversal at
+    // rotate, which is how far the result has to be rotated back.
+    int canonicalOffset(int rotate, int k) const {
+        int inWindow = (n - rotate) % n;
+        return inWindow < k ? (rotate + k - 1 - inWindow) % n : 0;
+    }
+
+    // Fills batch with every successor of state, in action order, rotated to
+    // canonical form if canonical is set (state must then be canonical). The
+    // successor reached by skip (-1 for none) need not be scored. Without
+    // tokens, only the parent and the rotation offsets are filled in.
+    void fillSuccessorBatch(const TopSpinState& state, bool canonical, int skip, bool tokens,
+                            topspin::SuccessorBatch& batch) const;
+    using HeuristicFunc = int(*)(const std::vector<uint8_t>&, int);
+    // Looks a heuristic up by name, or returns nullptr for an unknown name.
+    // Searches resolve the name once and evaluate through the result.
+    static HeuristicFunc resolveHeuristic(const std::string& heuristic);
+    // Batch version of a heuristic that has one, or nullptr. readsSuccessors
+    // tells whether it needs the successors' tokens or only the parent.
+    static topspin::BatchHeuristicFunc resolveBatchHeuristic(const std::string& heuristic, bool* readsSuccessors = nullptr);
+    // Names resolveHeuristic accepts, in alphabetical order.
+    static std::vector<std::string> heuristicNames();
+    int h(const TopSpinState& state, HeuristicFunc heuristic) const {
+        if (!heuristic) return INT_MAX;
+        thread_local std::vector<uint8_t> permutation;
+        state.unpack(permutation);
+        return heuristic(permutation, state.k);
+    }
     int h(const TopSpinState& state, const std::string& heuristic) const;
+
+    // Number of neighbouring token pairs that are not consecutive, the count
+    // behind the gap heuristic.
+    int gaps(const TopSpinState& state) const;
+    // Gap count after applying action to state, given the gap count of state.
+    // A reversal only changes the two adjacencies at the window's boundaries.
+    int gapsAfter(const TopSpinState& state, int stateGaps, const TopSpinAction& action) const;
+    static int gapHeuristic(int gaps) { return (gaps + 1) / 2; }
+
+    // Heuristic policies the search engines are instantiated with, so the
+    // evaluation is inlined into successor generation. Every node carries one
+    // int of policy data from its parent: data() computes it for a root,
+    // childData() for the successor reached by action, and value() turns a
+    // state and its data into h. Policies with BATCHED set also score all
+    // successors of a state at once with successorValues(), indexed by
+    // action and leaving out[skip] unset, and the engines use that instead of
+    // value() for successors.
+    // The gap policy is not batched: its incremental update is already O(1)
+    // per successor.
+    struct GapPolicy {
+        static constexpr bool BATCHED = false;
+        int data(const TopSpinStateSpace& space, const TopSpinState& state) const {
+            return space.gaps(state);
+        }
+        int childData(const TopSpinStateSpace& space, const TopSpinState& parent, int parentGaps,
+                      const TopSpinAction& action) const {
+            return space.gapsAfter(parent, parentGaps, action);
+        }
+        int value(const TopSpinStateSpace&, const TopSpinState&, int gaps) const {
+            TOPSPIN_PROFILE_COUNT("heuristic.gapIncremental", 1);
+            return gapHeuristic(gaps);
+        }
+    };
+
+    struct CompositePolicy {
+        static constexpr bool BATCHED = true;
+        const topspin::CompositeHeuristic* composite;
+        int data(const TopSpinStateSpace&, const TopSpinState&) const { return -1; }
+        int childData(const TopSpinStateSpace&, const TopSpinState&, int, const TopSpinAction&) const { return -1; }
+        int value(const TopSpinStateSpace&, const TopSpinState& state, int) const {
+            thread_local std::vector<uint8_t> permutation;
+            state.unpack(permutation);
+            return composite->evaluate(permutation, state.k);
+        }
+        void successorValues(const TopSpinStateSpace& space, const TopSpinState& state, bool canonical, int skip, int* out) const {
+            thread_local topspin::SuccessorBatch batch;
+            space.fillSuccessorBatch(state, canonical, skip, composite->readsSuccessors(), batch);
+            composite->evaluateBatch(batch, state.k, out);
+        }
+    };
+
+    struct BatchFunctionPolicy {
+        static constexpr bool BATCHED = true;
+        HeuristicFunc function;
+        topspin::BatchHeuristicFunc batchFunction;
+        bool readsSuccessors;
+        int data(const TopSpinStateSpace&, const TopSpinState&) const { return -1; }
+        int childData(const TopSpinStateSpace&, const TopSpinState&, int, const TopSpinAction&) const { return -1; }
+        int value(const TopSpinStateSpace& space, const TopSpinState& state, int) const {
+            return space.h(state, function);
+        }
+        void successorValues(const TopSpinStateSpace& space, const TopSpinState& state, bool canonical, int skip, int* out) const {
+            thread_local topspin::SuccessorBatch batch;
+            space.fillSuccessorBatch(state, canonical, skip, readsSuccessors, batch);
+            batchFunction(batch, state.k, out);
+        }
+    };
+
+    struct FunctionPolicy {
+        static constexpr bool BATCHED = false;
+        HeuristicFunc function;
+        int data(const TopSpinStateSpace&, const TopSpinState&) const { return -1; }
+        int childData(const TopSpinStateSpace&, const TopSpinState&, int, const TopSpinAction&) const { return -1; }
+        int value(const TopSpinStateSpace& space, const TopSpinState& state, int) const {
+            return space.h(state, function);
+        }
+    };
+
+    // Resolves the heuristic name and calls run with the matching policy.
+    template <typename Run>
+    static decltype(auto) withHeuristic(const std::string& heuristic, Run&& run) {
+        if (heuristic == "gap") return run(GapPolicy{});
+        if (const topspin::CompositeHeuristic* composite = topspin::CompositeHeuristic::get(heuristic))
+            return run(CompositePolicy{composite});
+        // A single abstraction has the same values as the composite of just
+        // that abstraction, which has a batch evaluation.
+        if (const topspin::CompositeHeuristic* composite = topspin::CompositeHeuristic::get("max:" + heuristic))
+            return run(CompositePolicy{composite});
+        bool readsSuccessors = false;
+        if (topspin::BatchHeuristicFunc batchFunction = resolveBatchHeuristic(heuristic, &readsSuccessors))
+            return run(BatchFunctionPolicy{resolveHeuristic(heuristic), batchFunction, readsSuccessors});
+        return run(FunctionPolicy{resolveHeuristic(heuristic)});
+    }
 };
 
+namespace std {
+    template <>
+    struct hash<TopSpinStateSpace::TopSpinState> {
+        size_t operator()(const TopSpinStateSpace::TopSpinState& state) const {
+            return state.hash();
+        }
+    };
+}
+
 #endif
@@ -0,0 +1,142 @@
+#ifndef TOPSPIN_TRANSPOSITION_TABLE_H
+#define TOPSPIN_TRANSPOSITION_TABLE_H
+
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+
+namespace topspin {
+
+// Fixed-size, open-addressed transposition table for IDA*. Entries live in
+// buckets of BUCKET_SIZE slots and carry the iteration that last wrote them:
+// g prunes duplicates only within that iteration, while the backed-up h is a
+// lower bound on the distance to the goal that stays valid in every later
+// iteration. A full bucket gives up its entry from an older iteration first
+// and otherwise the one farthest from the root, so the entries with the
+// largest subtrees stay (depth-preferred replacement).
+//
+// The table is allocated once with calloc, so pages that are never used are
+// never touched.
+class TranspositionTable {
+public:
+    // 128-bit key; the packed state itself where it fits, a fingerprint otherwise.
+    struct Key {
+        uint64_t lo;
+        uint64_t hi;
+        bool operator==(const Key& other) const { return lo == other.lo && hi == other.hi; }
+    };
+
+    struct Entry {
+        Key key;
+        uint16_t g;           // UNKNOWN_G if the path was too long to record
+        uint16_t iteration;   // 0 marks an empty slot
+        uint8_t h;
+    };
+    static_assert(sizeof(Entry) == 24, "transposition table entries must stay 24 bytes");
+
+    static constexpr size_t BUCKET_SIZE = 4;
+    static constexpr uint16_t UNKNOWN_G = UINT16_MAX;
+
+    explicit TranspositionTable(size_t maxBytes) {
+        size_t buckets = 1;
+        while (buckets * 2 * BUCKET_SIZE * sizeof(Entry) <= maxBytes) buckets *= 2;
+        if (maxBytes < BUCKET_SIZE * sizeof(Entry)) buckets = 0;
+        mask = buckets ? buckets - 1 : 0;
+        if (buckets) entries.reset(static_cast<Entry*>(std::calloc(buckets * BUCKET_SIZE, sizeof(Entry))));
+        if (!entries) mask = 0;
+    }
+
+    bool enabled() const { return entries != nullptr; }
+    size_t capacity() const { return enabled() ? (mask + 1) * BUCKET_SIZE : 0; }
+    size_t bytes() const { return capacity() * sizeof(Entry); }
+    uint64_t stored() const { return used; }
+
+    // Starts a new iteration; entries of earlier ones keep only their h.
+    void nextIteration() {
+        if (++iteration == 0) {
+            // Stamps wrapped around: forget everything rather than confuse
+            // an old iteration with the current one.
+            std::fill(entries.get(), entries.get() + capacity(), Entry{});
+            used = 0;
+            iteration = 1;
+        }
+    }
+
+    // Entry for key, or nullptr if it is not stored.
+    const Entry* find(const Key& key) const {
+        if (!enabled()) return nullptr;
+        const Entry* bucket = bucketOf(key);
+        for (size_t i = 0; i < BUCKET_SIZE; i++) {
+            if (bucket[i].iteration != 0 && bucket[i].key == key) return &bucket[i];
+        }
+        return nullptr;
+    }
+
+    bool current(const Entry& entry) const { return entry.iteration == iteration; }
+
+    // Whether this iteration already reached the entry's state at a cost of
+    // at most g.
+    bool reachedWithin(const Entry& entry, double g) const {
+        return current(entry) && entry.g != UNKNOWN_G && entry.g <= g;
+    }
+
+    // Records that key was reached with cost g in this iteration and that h
+    // bounds its distance from below. A stored h is never lowered, and a
+    // stored g only within its own iteration.
+    void store(const Key& key, int g, int h) {
+        if (!enabled()) return;
+        // A clamped h is still a lower bound; a clamped g would not be an
+        // upper bound, so it becomes UNKNOWN_G, which never cuts a node.
+        uint16_t g16 = static_cast<uint16_t>(std::clamp(g, 0, static_cast<int>(UNKNOWN_G)));
+        uint8_t h8 = static_cast<uint8_t>(std::clamp(h, 0, 255));
+        Entry* bucket = bucketOf(key);
+        Entry* victim = nullptr;
+        for (size_t i = 0; i < BUCKET_SIZE; i++) {
+            Entry& entry = bucket[i];
+            if (entry.iteration != 0 && entry.key == key) {
+                if (entry.iteration != iteration || g16 < entry.g) entry.g = g16;
+                entry.h = std::max(entry.h, h8);
+                entry.iteration = iteration;
+                return;
+            }
+            if (!victim || rank(entry) > rank(*victim)) victim = &entry;
+        }
+        // Entries of this iteration that are closer to the root than the new
+        // one stay.
+        if (victim->iteration == iteration && victim->g <= g16) return;
+        if (victim->iteration == 0) used++;
+        *victim = Entry{key, g16, iteration, h8};
+    }
+
+private:
+    struct Free {
+        void operator()(Entry* p) const { std::free(p); }
+    };
+
+    // Replacement preference: empty slots, then older iterations, then the
+    // largest g.
+    int rank(const Entry& entry) const {
+        if (entry.iteration == 0) return 1 << 20;
+        if (entry.iteration != iteration) return (1 << 19) + entry.g;
+        return entry.g;
+    }
+
+    Entry* bucketOf(const Key& key) const {
+        uint64_t h = key.lo ^ (key.hi * 0x9e3779b97f4a7c15ULL);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return entries.get() + (h & mask) * BUCKET_SIZE;
+    }
+
+    std::unique_ptr<Entry[], Free> entries;
+    size_t mask = 0;
+    uint16_t iteration = 1;
+    uint64_t used = 0;
+};
+
+} // namespace topspin
+
+#endif // TOPSPIN_TRANSPOSITION_TABLE_H